@@ -0,0 +1,38 @@
+#include "arena.h"
+
+arena::block *arena::newBlock(size_t bytes) {
+    blocks.emplace_back(new block);
+    block *b = blocks.back().get();
+    b->data.reset(new char[bytes]);
+    b->size = bytes;
+    usage += bytes;
+    return b;
+}
+
+char *arena::allocate(size_t bytes) {
+    bytes = (bytes + 7) & ~size_t(7);
+    if (bytes > ARENA_BLOCK_SIZE / 4) {
+        std::lock_guard<std::mutex> guard(lock);
+        block *b = newBlock(bytes); // 当前块剩下的空间留给之后的小对象
+        b->used  = bytes;
+        return b->data.get();
+    }
+    while (true) {
+        block *b = cur.load(std::memory_order_acquire);
+        if (b) {
+            size_t off = b->used.fetch_add(bytes, std::memory_order_relaxed);
+            if (off + bytes <= b->size)
+                return b->data.get() + off;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        if (cur.load(std::memory_order_relaxed) == b) // 别的线程可能已经换过块
+            cur.store(newBlock(ARENA_BLOCK_SIZE), std::memory_order_release);
+    }
+}
+
+void arena::reset() {
+    std::lock_guard<std::mutex> guard(lock);
+    blocks.clear();
+    cur   = nullptr;
+    usage = 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#ifndef LSM_KV_ARENA_H
+#define LSM_KV_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ * memtable 的内存池：从按块申请的大内存中顺序切出空间，单个对象不单独释放，
+ * memtable 落盘后整个 arena 一次释放。超过块大小 1/4 的申请单独占一块，避免浪费当前块的剩余空间。
+ * 多个写者可以同时申请：在当前块内用 fetch_add 切分，只有换块时才加锁。
+ */
+const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+class arena {
+private:
+    struct block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+        std::atomic<size_t> used{0}; // 可能超过 size，超出的部分说明这个块已经切完
+    };
+
+    std::mutex lock; // 保护 blocks 和换块
+    std::vector<std::unique_ptr<block>> blocks;
+    std::atomic<block *> cur{nullptr}; // 小对象从这个块中切分
+    std::atomic<size_t> usage{0};      // 申请过的所有块的总字节数
+
+    block *newBlock(size_t bytes); // 调用时持有 lock
+
+public:
+    char *allocate(size_t bytes); // 按 8 字节对齐
+
+    size_t getUsage() const {
+        return usage;
+    }
+
+    void reset(); // 释放所有块，不能与 allocate 并发
+};
+
+#endif // LSM_KV_ARENA_H
@@ -0,0 +1,327 @@
+#include "artmemtable.h"
+
+#include <cstring>
+#include <limits>
+#include <new>
+
+struct artmemtable::leaf {
+    uint64_t key;
+    const char *val; // 为空表示已删除
+};
+
+namespace {
+
+enum artType : uint8_t {
+    NODE4,
+    NODE16,
+    NODE48,
+    NODE256
+};
+
+struct artNode {
+    artType type;
+    uint16_t count; // 孩子数
+};
+
+// node4 / node16 的 keys 按字节升序，与 child 一一对应
+struct artNode4 : artNode {
+    uint8_t keys[4];
+    void *child[4];
+};
+
+struct artNode16 : artNode {
+    uint8_t keys[16];
+    void *child[16];
+};
+
+struct artNode48 : artNode {
+    uint8_t index[256]; // 字节对应的槽号 + 1，0 表示没有这个孩子
+    void *child[48];
+};
+
+struct artNode256 : artNode {
+    void *child[256];
+};
+
+// 叶子指针的最低位置 1，与内部节点区分
+inline bool isLeaf(const void *p) {
+    return reinterpret_cast<uintptr_t>(p) & 1;
+}
+
+template <class T> inline T *asLeaf(void *p) {
+    return reinterpret_cast<T *>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(1));
+}
+
+inline void *tagLeaf(void *p) {
+    return reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(p) | 1);
+}
+
+inline uint8_t keyByte(uint64_t key, int depth) {
+    return key >> (56 - 8 * depth);
+}
+
+void **findChild(artNode *node, uint8_t byte) {
+    switch (node->type) {
+    case NODE4: {
+        auto *n = static_cast<artNode4 *>(node);
+        for (int i = 0; i < n->count; ++i) {
+            if (n->keys[i] == byte)
+                return &n->child[i];
+        }
+        return nullptr;
+    }
+    case NODE16: {
+        auto *n = static_cast<artNode16 *>(node);
+        for (int i = 0; i < n->count && n->keys[i] <= byte; ++i) {
+            if (n->keys[i] == byte)
+                return &n->child[i];
+        }
+        return nullptr;
+    }
+    case NODE48: {
+        auto *n = static_cast<artNode48 *>(node);
+        return n->index[byte] ? &n->child[n->index[byte] - 1] : nullptr;
+    }
+    default: {
+        auto *n = static_cast<artNode256 *>(node);
+        return n->child[byte] ? &n->child[byte] : nullptr;
+    }
+    }
+}
+
+// 在有序的 keys / child 中插入，调用者保证还有空位
+void insertSorted(uint8_t *keys, void **child, uint16_t &count, uint8_t byte, void *c) {
+    int i = count;
+    for (; i > 0 && keys[i - 1] > byte; --i) {
+        keys[i]  = keys[i - 1];
+        child[i] = child[i - 1];
+    }
+    keys[i]  = byte;
+    child[i] = c;
+    ++count;
+}
+
+} // namespace
+
+void artmemtable::init() {
+    root = nullptr;
+}
+
+artmemtable::leaf *artmemtable::newLeaf(uint64_t key, const char *rec) {
+    leaf *l = new (mem.allocate(sizeof(leaf))) leaf;
+    l->key  = key;
+    l->val  = rec;
+    return l;
+}
+
+template <class T> T *artmemtable::newNode() {
+    return new (mem.allocate(sizeof(T))) T(); // 值初始化，孩子全部为空
+}
+
+void artmemtable::addChild(void **ref, uint8_t byte, void *child) {
+    artNode *node = static_cast<artNode *>(*ref);
+    switch (node->type) {
+    case NODE4: {
+        auto *n = static_cast<artNode4 *>(node);
+        if (n->count < 4)
+            return insertSorted(n->keys, n->child, n->count, byte, child);
+        auto *bigger = newNode<artNode16>();
+        bigger->type = NODE16;
+        std::memcpy(bigger->keys, n->keys, sizeof(n->keys));
+        std::memcpy(bigger->child, n->child, sizeof(n->child));
+        bigger->count = n->count;
+        *ref          = bigger;
+        break;
+    }
+    case NODE16: {
+        auto *n = static_cast<artNode16 *>(node);
+        if (n->count < 16)
+            return insertSorted(n->keys, n->child, n->count, byte, child);
+        auto *bigger = newNode<artNode48>();
+        bigger->type = NODE48;
+        for (int i = 0; i < n->count; ++i) {
+            bigger->index[n->keys[i]] = i + 1;
+            bigger->child[i]          = n->child[i];
+        }
+        bigger->count = n->count;
+        *ref          = bigger;
+        break;
+    }
+    case NODE48: {
+        auto *n = static_cast<artNode48 *>(node);
+        if (n->count < 48) { // 孩子不会被摘下，槽按顺序使用
+            n->child[n->count] = child;
+            n->index[byte]     = ++n->count;
+            return;
+        }
+        auto *bigger = newNode<artNode256>();
+        bigger->type = NODE256;
+        for (int b = 0; b < 256; ++b) {
+            if (n->index[b])
+                bigger->child[b] = n->child[n->index[b] - 1];
+        }
+        bigger->count = n->count;
+        *ref          = bigger;
+        break;
+    }
+    default: {
+        auto *n        = static_cast<artNode256 *>(node);
+        n->child[byte] = child;
+        ++n->count;
+        return;
+    }
+    }
+    addChild(ref, byte, child); // 换成更大的节点之后再插入
+}
+
+artmemtable::leaf *artmemtable::lookup(uint64_t key) const {
+    void *p = root;
+    for (int depth = 0; p && !isLeaf(p); ++depth) {
+        void **slot = findChild(static_cast<artNode *>(p), keyByte(key, depth));
+        p           = slot ? *slot : nullptr;
+    }
+    if (!p)
+        return nullptr;
+    leaf *l = asLeaf<leaf>(p);
+    return l->key == key ? l : nullptr;
+}
+
+int64_t artmemtable::upsert(uint64_t key, std::string_view val) {
+    const char *rec = newValue(val);
+    std::unique_lock<std::shared_mutex> guard(lock);
+    void **ref = &root;
+    for (int depth = 0;; ++depth) {
+        if (!*ref) {
+            *ref = tagLeaf(newLeaf(key, rec));
+            break;
+        }
+        if (isLeaf(*ref)) {
+            leaf *old = asLeaf<leaf>(*ref);
+            if (old->key == key) {
+                const char *prev = old->val;
+                old->val         = rec;
+                return account(prev, rec);
+            }
+            // 两个 key 相同的字节各建一个只有一个孩子的 node4，在第一个不同的字节处分开
+            void *oldRef = *ref;
+            for (; keyByte(old->key, depth) == keyByte(key, depth); ++depth) {
+                auto *n    = newNode<artNode4>();
+                n->type    = NODE4;
+                n->keys[0] = keyByte(key, depth);
+                n->count   = 1;
+                *ref       = n;
+                ref        = &n->child[0];
+            }
+            auto *n = newNode<artNode4>();
+            n->type = NODE4;
+            *ref    = n;
+            addChild(ref, keyByte(old->key, depth), oldRef);
+            addChild(ref, keyByte(key, depth), tagLeaf(newLeaf(key, rec)));
+            break;
+        }
+        void **next = findChild(static_cast<artNode *>(*ref), keyByte(key, depth));
+        if (!next) {
+            addChild(ref, keyByte(key, depth), tagLeaf(newLeaf(key, rec)));
+            break;
+        }
+        ref = next;
+    }
+    return account(nullptr, rec);
+}
+
+std::string artmemtable::search(uint64_t key) {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    leaf *l = lookup(key);
+    return l ? std::string(view(l->val)) : "";
+}
+
+bool artmemtable::del(uint64_t key) {
+    std::unique_lock<std::shared_mutex> guard(lock);
+    leaf *l = lookup(key);
+    if (!l || !l->val)
+        return false;
+    account(l->val, nullptr);
+    l->val = nullptr;
+    return true;
+}
+
+// prefix 为这棵子树的 key 在 depth 之前的字节，按字节升序访问孩子，子树的 key 范围与 [key1, key2] 不相交时跳过
+void artmemtable::walk(void *node, int depth, uint64_t prefix, uint64_t key1, uint64_t key2,
+                       const std::function<void(leaf *)> &visit) const {
+    if (isLeaf(node)) {
+        leaf *l = asLeaf<leaf>(node);
+        if (l->key >= key1 && l->key <= key2)
+            visit(l);
+        return;
+    }
+    int shift  = 56 - 8 * depth;
+    auto child = [&](uint8_t byte, void *c) { // 返回 false 时后面的孩子都大于 key2
+        uint64_t first = prefix | (uint64_t)byte << shift;
+        uint64_t last  = first | ((uint64_t(1) << shift) - 1);
+        if (first > key2)
+            return false;
+        if (last >= key1)
+            walk(c, depth + 1, first, key1, key2, visit);
+        return true;
+    };
+    artNode *n = static_cast<artNode *>(node);
+    switch (n->type) {
+    case NODE4: {
+        auto *x = static_cast<artNode4 *>(n);
+        for (int i = 0; i < x->count && child(x->keys[i], x->child[i]); ++i)
+            ;
+        break;
+    }
+    case NODE16: {
+        auto *x = static_cast<artNode16 *>(n);
+        for (int i = 0; i < x->count && child(x->keys[i], x->child[i]); ++i)
+            ;
+        break;
+    }
+    case NODE48: {
+        auto *x = static_cast<artNode48 *>(n);
+        for (int b = 0; b < 256; ++b) {
+            if (x->index[b] && !child(b, x->child[x->index[b] - 1]))
+                break;
+        }
+        break;
+    }
+    default: {
+        auto *x = static_cast<artNode256 *>(n);
+        for (int b = 0; b < 256; ++b) {
+            if (x->child[b] && !child(b, x->child[b]))
+                break;
+        }
+    }
+    }
+}
+
+void artmemtable::removeRange(uint64_t key1, uint64_t key2) {
+    std::unique_lock<std::shared_mutex> guard(lock);
+    if (!root)
+        return;
+    walk(root, 0, 0, key1, key2, [this](leaf *l) {
+        account(l->val, nullptr);
+        l->val = nullptr;
+    });
+}
+
+void artmemtable::scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    if (!root)
+        return;
+    walk(root, 0, 0, key1, key2, [&list](leaf *l) {
+        if (l->val)
+            list.emplace_back(l->key, std::string(view(l->val)));
+    });
+}
+
+void artmemtable::forEach(const memtableVisitor &visit) {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    if (!root)
+        return;
+    walk(root, 0, 0, 0, std::numeric_limits<uint64_t>::max(), [&visit](leaf *l) {
+        if (l->val)
+            visit(l->key, view(l->val));
+    });
+}
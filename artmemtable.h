@@ -0,0 +1,45 @@
+#pragma once
+
+#ifndef LSM_KV_ARTMEMTABLE_H
+#define LSM_KV_ARTMEMTABLE_H
+
+#include "memtable.h"
+
+#include <shared_mutex>
+
+/*
+ * 自适应基数树（ART）memtable，专门处理 uint64 key：按大端的 8 个字节逐层分支，树高不超过 8，
+ * 查找不做 key 比较，只在叶子处比较一次。内部节点按孩子数在 node4 / node16 / node48 / node256 之间扩展，
+ * 稀疏处省内存，稠密处直接按字节寻址。只有一个 key 的子树直接存叶子（lazy expansion），插入第二个 key 时再分裂。
+ * 孩子按字节有序，scan 按子树的 key 范围剪枝。写者互斥，读者共享一把读写锁；扩展后旧节点随 arena 释放。
+ */
+class artmemtable : public memtable {
+private:
+    void *root = nullptr; // 内部节点或打了标记的叶子
+    mutable std::shared_mutex lock;
+
+    struct leaf;
+    leaf *lookup(uint64_t key) const;
+    leaf *newLeaf(uint64_t key, const char *rec);
+    template <class T> T *newNode();
+    void addChild(void **ref, uint8_t byte, void *child); // *ref 为内部节点，满了先换成更大的节点
+    void walk(void *node, int depth, uint64_t prefix, uint64_t key1, uint64_t key2,
+              const std::function<void(leaf *)> &visit) const; // 按 key 升序访问 [key1, key2] 中的叶子
+
+protected:
+    void init() override;
+    void removeRange(uint64_t key1, uint64_t key2) override;
+
+public:
+    artmemtable() {
+        init();
+    }
+
+    int64_t upsert(uint64_t key, std::string_view val) override;
+    std::string search(uint64_t key) override;
+    bool del(uint64_t key) override;
+    void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) override;
+    void forEach(const memtableVisitor &visit) override;
+};
+
+#endif // LSM_KV_ARTMEMTABLE_H
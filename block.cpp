@@ -0,0 +1,79 @@
+#include "block.h"
+
+#include <cstring>
+
+void Footer::encode(std::string &buf) const {
+    char tmp[FOOTER_SIZE];
+    std::memcpy(tmp, &time, 8);
+    std::memcpy(tmp + 8, &cnt, 8);
+    std::memcpy(tmp + 16, &minV, 8);
+    std::memcpy(tmp + 24, &maxV, 8);
+    std::memcpy(tmp + 32, &metaOffset, 4);
+    std::memcpy(tmp + 36, &blockCnt, 4);
+    std::memcpy(tmp + 40, &version, 4);
+    std::memcpy(tmp + 44, &rangeDelCnt, 4);
+    std::memcpy(tmp + 48, &SST_MAGIC, 8);
+    buf.append(tmp, FOOTER_SIZE);
+}
+
+bool Footer::decode(const char *buf) {
+    uint64_t magic;
+    std::memcpy(&magic, buf + 48, 8);
+    if (magic != SST_MAGIC)
+        return false;
+    std::memcpy(&time, buf, 8);
+    std::memcpy(&cnt, buf + 8, 8);
+    std::memcpy(&minV, buf + 16, 8);
+    std::memcpy(&maxV, buf + 24, 8);
+    std::memcpy(&metaOffset, buf + 32, 4);
+    std::memcpy(&blockCnt, buf + 36, 4);
+    std::memcpy(&version, buf + 40, 4);
+    std::memcpy(&rangeDelCnt, buf + 44, 4);
+    return true;
+}
+
+void block::append(std::string &buf, uint64_t key, const std::string &val) {
+    uint32_t len = val.length();
+    buf.append(reinterpret_cast<const char *>(&key), 8);
+    buf.append(reinterpret_cast<const char *>(&len), 4);
+    buf.append(val);
+}
+
+// 块内条目按 key 有序，块不超过 BLOCK_SIZE（单个大 value 除外），顺序查找即可
+bool block::find(const char *buf, uint32_t size, uint64_t key, std::string &val) {
+    std::string_view view;
+    if (!find(buf, size, key, view))
+        return false;
+    val.assign(view.data(), view.size());
+    return true;
+}
+
+bool block::find(const char *buf, uint32_t size, uint64_t key, std::string_view &val) {
+    uint32_t pos = 0;
+    while (pos + 12 <= size) {
+        uint64_t cur;
+        uint32_t len;
+        std::memcpy(&cur, buf + pos, 8);
+        std::memcpy(&len, buf + pos + 8, 4);
+        if (cur == key) {
+            val = std::string_view(buf + pos + 12, len);
+            return true;
+        }
+        if (cur > key)
+            return false;
+        pos += 12 + len;
+    }
+    return false;
+}
+
+void block::decode(const char *buf, uint32_t size, std::vector<std::pair<uint64_t, std::string>> &out) {
+    uint32_t pos = 0;
+    while (pos + 12 <= size) {
+        uint64_t key;
+        uint32_t len;
+        std::memcpy(&key, buf + pos, 8);
+        std::memcpy(&len, buf + pos + 8, 4);
+        out.emplace_back(key, std::string(buf + pos + 12, len));
+        pos += 12 + len;
+    }
+}
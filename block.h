@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef LSM_KV_BLOCK_H
+#define LSM_KV_BLOCK_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * 块格式 (FORMAT_BLOCK) 的 sstable 文件布局：
+ *   [data block 0][padding] ... [data block n-1][padding]
+ *   [bloom filter (分块布局 64n + 4 字节；早期的文件为固定 M 字节，见 bloom.h)]
+ *   [block index: n * (lastKey u64, offset u32, size u32)]
+ *   [range tombstones: m * (start u64, end u64)]
+ *   [footer (FOOTER_SIZE bytes)]
+ * 每个 data block 内连续存放 (key u64, len u32, value) 条目，块起点按 BLOCK_SIZE 对齐。
+ * 内存中每个块只保留一个 BlockHandle，而不是每个 key 一个 Index。
+ */
+const uint32_t BLOCK_SIZE    = 4096;
+const uint32_t FOOTER_SIZE   = 56;
+const uint64_t SST_MAGIC     = 0xc3a1f0e2d4b59687ULL;
+const uint32_t FORMAT_LEGACY = 1; // header + bloom + 每个 key 一个 index + data
+const uint32_t FORMAT_BLOCK  = 2; // data blocks + bloom + 稀疏 block index + footer
+
+struct BlockHandle {
+    uint64_t lastKey; // 块内最大的 key
+    uint32_t offset;  // 块在文件中的起始位置
+    uint32_t size;    // 块的有效字节数（不含 padding）
+
+    BlockHandle() {}
+
+    BlockHandle(uint64_t lastKey, uint32_t offset, uint32_t size) {
+        this->lastKey = lastKey;
+        this->offset  = offset;
+        this->size    = size;
+    }
+
+    bool operator<(const BlockHandle &b) const {
+        return this->lastKey < b.lastKey;
+    }
+};
+
+struct Footer {
+    uint64_t time, cnt, minV, maxV;
+    uint32_t metaOffset; // bloom + block index 的起始位置
+    uint32_t blockCnt;
+    uint32_t version;
+    uint32_t rangeDelCnt = 0; // 范围删除区间个数，早期的块格式文件此处为 0
+
+    void encode(std::string &buf) const;
+    bool decode(const char *buf); // magic 不匹配时返回 false，说明是旧格式
+};
+
+namespace block {
+void append(std::string &buf, uint64_t key, const std::string &val);
+bool find(const char *buf, uint32_t size, uint64_t key, std::string &val);
+bool find(const char *buf, uint32_t size, uint64_t key, std::string_view &val); // val 指向 buf 内部，不复制
+void decode(const char *buf, uint32_t size, std::vector<std::pair<uint64_t, std::string>> &out);
+} // namespace block
+
+#endif // LSM_KV_BLOCK_H
@@ -0,0 +1,82 @@
+#include "blockcache.h"
+
+void blockcache::setCapacity(size_t capacity) {
+    this->capacity = capacity / CACHE_SHARDS;
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        evict(shard);
+    }
+}
+
+void blockcache::evict(Shard &shard) {
+    while (shard.usage > capacity && !shard.lru.empty()) {
+        Entry &last = shard.lru.back();
+        shard.usage -= last.val.size();
+        shard.table.erase(makeKey(last.file, last.offset));
+        shard.lru.pop_back();
+    }
+}
+
+bool blockcache::lookup(const std::string &file, uint32_t offset, std::string &val) {
+    std::string key = makeKey(file, offset);
+    Shard &shard    = shardOf(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.table.find(key);
+    if (it == shard.table.end()) {
+        misses++;
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second); // 移到表头
+    val = it->second->val;
+    hits++;
+    return true;
+}
+
+void blockcache::insert(const std::string &file, uint32_t offset, const std::string &val) {
+    if (val.size() > capacity)
+        return; // 比整个分片还大，不缓存
+    std::string key = makeKey(file, offset);
+    Shard &shard    = shardOf(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.table.find(key);
+    if (it != shard.table.end()) {
+        shard.usage -= it->second->val.size();
+        shard.lru.erase(it->second);
+    }
+    shard.lru.push_front(Entry{file, offset, val});
+    shard.table[key] = shard.lru.begin();
+    shard.usage += val.size();
+    evict(shard);
+}
+
+void blockcache::erase(const std::string &file) {
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        for (auto it = shard.lru.begin(); it != shard.lru.end();) {
+            if (it->file == file) {
+                shard.usage -= it->val.size();
+                shard.table.erase(makeKey(it->file, it->offset));
+                it = shard.lru.erase(it);
+            } else
+                ++it;
+        }
+    }
+}
+
+void blockcache::clear() {
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.lru.clear();
+        shard.table.clear();
+        shard.usage = 0;
+    }
+}
+
+size_t blockcache::getUsage() {
+    size_t usage = 0;
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        usage += shard.usage;
+    }
+    return usage;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#ifndef LSM_KV_BLOCKCACHE_H
+#define LSM_KV_BLOCKCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+ * 挡在 fetchString 前面的分片 LRU 缓存，key 为 (文件名, 起始 offset)，value 为读出的字节串。
+ * sstable 文件写出后不再修改，所以只有文件被删除时（compaction / reset）才需要失效。
+ * 每个分片一把锁，容量按字节计，平均分给各分片；容量为 0 时不缓存。
+ */
+const size_t CACHE_SHARDS           = 16;
+const size_t DEFAULT_CACHE_CAPACITY = 64 * 1024 * 1024; // 64MB
+
+class blockcache {
+private:
+    struct Entry {
+        std::string file;
+        uint32_t offset;
+        std::string val;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::list<Entry> lru; // 表头是最近使用的
+        std::unordered_map<std::string, std::list<Entry>::iterator> table;
+        size_t usage = 0;
+    };
+
+    Shard shards[CACHE_SHARDS];
+    std::atomic<size_t> capacity; // 每个分片的容量，setCapacity 可以和读写并发
+    std::atomic<uint64_t> hits{0}, misses{0};
+
+    static std::string makeKey(const std::string &file, uint32_t offset) {
+        return file + "#" + std::to_string(offset);
+    }
+
+    Shard &shardOf(const std::string &key) {
+        return shards[std::hash<std::string>()(key) % CACHE_SHARDS];
+    }
+
+    void evict(Shard &shard); // 淘汰到容量以内，调用者持有分片锁
+
+public:
+    blockcache(size_t capacity = DEFAULT_CACHE_CAPACITY) {
+        setCapacity(capacity);
+    }
+
+    void setCapacity(size_t capacity);
+
+    bool lookup(const std::string &file, uint32_t offset, std::string &val);
+    void insert(const std::string &file, uint32_t offset, const std::string &val);
+    void erase(const std::string &file); // 删除某个文件的全部缓存项
+    void clear();
+
+    uint64_t getHits() const {
+        return hits.load();
+    }
+
+    uint64_t getMisses() const {
+        return misses.load();
+    }
+
+    size_t getUsage();
+};
+
+#endif // LSM_KV_BLOCKCACHE_H
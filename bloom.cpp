@@ -1,19 +1,265 @@
 #include "bloom.h"
 
+#include <algorithm>
+#include <cstring>
+
+void bloom::reset() {
+    words.assign(M / 8, 0);
+    blocked = false;
+    kind    = FILTER_BLOOM;
+    probes  = 4;
+    pending.clear();
+}
+
+void bloom::reset(filterPolicy policy) {
+    policy.bitsPerKey = std::max(1u, policy.bitsPerKey);
+    this->policy      = policy;
+    words.clear();
+    blocked = true;
+    kind    = policy.bitsPerKey < 9 ? FILTER_BLOOM : policy.kind;
+    seed    = 0;
+    if (kind == FILTER_XOR)
+        probes = policy.bitsPerKey < 18 ? 8 : 16;
+    else
+        probes = std::min(12u, std::max(1u, policy.bitsPerKey * 69 / 100)); // bitsPerKey * ln2
+    pending.clear();
+}
+
+void bloom::hash(uint64_t key, uint64_t *hash) {
+    MurmurHash3_x64_128(&key, sizeof(key), 1, hash);
+}
+
+// 哈希值的第 i 个 32 位字，与按 uint32_t[4] 取时相同，已有的文件不受影响
+static inline uint32_t word(const uint64_t *h, int i) {
+    return (uint32_t)(h[i / 2] >> (i % 2 * 32));
+}
+
+// 用 h[0] 选行，h[1] 做 double hashing 生成行内的 probes 个位
+size_t bloom::lineAt(uint32_t h) const {
+    uint64_t lines = words.size() / 8;
+    return (h * lines >> 32) * 8;
+}
+
+void bloom::lineMask(uint32_t h, uint32_t probes, uint64_t *mask) {
+    uint32_t delta = (h >> 17) | (h << 15);
+    for (int w = 0; w < 8; ++w)
+        mask[w] = 0;
+    for (uint32_t i = 0; i < probes; ++i) {
+        mask[(h >> 6) & 7] |= 1ULL << (h & 63);
+        h += delta;
+    }
+}
+
+static uint64_t mix(uint64_t h, uint64_t seed) { // MurmurHash3 的 fmix64，换种子重新打散
+    h += seed * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint32_t reduce(uint32_t h, uint32_t n) { // 把 h 均匀映射到 [0, n)
+    return (uint64_t)h * n >> 32;
+}
+
+uint32_t bloom::segment() const {
+    return words.size() * 8 / (probes / 8) / 3;
+}
+
+void bloom::xorSlots(uint64_t h, uint32_t *slot) const {
+    uint32_t seg = segment();
+    slot[0]      = reduce((uint32_t)h, seg);
+    slot[1]      = reduce((uint32_t)(h >> 21), seg) + seg;
+    slot[2]      = reduce((uint32_t)(h >> 42 | h << 22), seg) + 2 * seg;
+}
+
+uint32_t bloom::fingerprint(uint64_t h) const {
+    return (h ^ h >> 32) & ((1u << probes) - 1);
+}
+
+uint32_t bloom::getFp(uint32_t i) const {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(words.data());
+    if (probes == 8)
+        return p[i];
+    uint16_t fp;
+    std::memcpy(&fp, p + 2 * i, 2);
+    return fp;
+}
+
+void bloom::setFp(uint32_t i, uint32_t fp) {
+    unsigned char *p = reinterpret_cast<unsigned char *>(words.data());
+    if (probes == 8) {
+        p[i] = fp;
+        return;
+    }
+    uint16_t v = fp;
+    std::memcpy(p + 2 * i, &v, 2);
+}
+
 void bloom::insert(uint64_t key) {
-    MurmurHash3_x64_128(&key, sizeof(key), 1, hashV);
-    for (int i = 0; i < 4; ++i) {
-        uint32_t p = (hashV[i] % (8 * M));
-        s[p]       = true;
+    uint64_t h[2];
+    hash(key, h);
+    if (!blocked) {
+        for (int i = 0; i < 4; ++i) {
+            uint32_t p = word(h, i) % (8 * M);
+            words[p >> 6] |= 1ULL << (p & 63);
+        }
+        return;
     }
+    if (words.empty() || kind == FILTER_XOR) { // 还没有 build；xor 构建之后不能再加 key
+        pending.push_back(h[0]);
+        return;
+    }
+    uint64_t mask[8];
+    lineMask(word(h, 1), probes, mask);
+    uint64_t *cur = &words[lineAt(word(h, 0))];
+    for (int w = 0; w < 8; ++w)
+        cur[w] |= mask[w];
 }
 
-bool bloom::search(uint64_t key) {
-    MurmurHash3_x64_128(&key, sizeof(key), 1, hashV);
-    for (int i = 0; i < 4; ++i) {
-        uint32_t p = (hashV[i] % (8 * M));
-        if (!s[p])
-            return false;
+void bloom::build() {
+    if (!blocked)
+        return;
+    if (kind == FILTER_XOR && !buildXor()) { // 极少见：退回 bloom
+        std::vector<uint64_t> keys;
+        keys.swap(pending);
+        reset(filterPolicy(FILTER_BLOOM, policy.bitsPerKey));
+        pending.swap(keys);
+    }
+    if (kind == FILTER_BLOOM)
+        buildBloom();
+    pending.clear();
+    pending.shrink_to_fit();
+}
+
+void bloom::buildBloom() {
+    uint64_t bits  = std::max<uint64_t>(1, pending.size()) * policy.bitsPerKey;
+    uint64_t lines = (bits + CACHE_LINE * 8 - 1) / (CACHE_LINE * 8);
+    words.assign(lines * 8, 0);
+    uint64_t mask[8];
+    for (uint64_t h : pending) {
+        lineMask(h >> 32, probes, mask);
+        uint64_t *cur = &words[lineAt((uint32_t)h)];
+        for (int w = 0; w < 8; ++w)
+            cur[w] |= mask[w];
+    }
+}
+
+// 剥离法：反复取出只被一个 key 占用的位置，按相反的顺序给这些位置填指纹
+bool bloom::buildXor() {
+    std::sort(pending.begin(), pending.end());
+    pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+    uint64_t n     = pending.size();
+    uint64_t fpLen = probes / 8;
+    uint64_t seg   = ((32 + n * 123 / 100) / 3 + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE; // 3 * seg * fpLen 是 64 的倍数
+    words.assign(3 * seg * fpLen / 8, 0);
+    std::vector<uint32_t> count(3 * seg);
+    std::vector<uint64_t> mixed(3 * seg); // 占用该位置的 key 的哈希的异或
+    std::vector<uint32_t> queue;
+    std::vector<std::pair<uint64_t, uint32_t>> order; // 剥离顺序：(哈希, 位置)
+    uint32_t slot[3];
+    for (seed = 1; seed <= 0xffff; ++seed) {
+        std::fill(count.begin(), count.end(), 0);
+        std::fill(mixed.begin(), mixed.end(), 0);
+        for (uint64_t h : pending) {
+            uint64_t x = mix(h, seed);
+            xorSlots(x, slot);
+            for (int i = 0; i < 3; ++i) {
+                count[slot[i]]++;
+                mixed[slot[i]] ^= x;
+            }
+        }
+        queue.clear();
+        order.clear();
+        for (uint32_t i = 0; i < 3 * seg; ++i) {
+            if (count[i] == 1)
+                queue.push_back(i);
+        }
+        while (!queue.empty()) {
+            uint32_t i = queue.back();
+            queue.pop_back();
+            if (count[i] != 1)
+                continue;
+            uint64_t x = mixed[i];
+            order.emplace_back(x, i);
+            xorSlots(x, slot);
+            for (int j = 0; j < 3; ++j) {
+                count[slot[j]]--;
+                mixed[slot[j]] ^= x;
+                if (count[slot[j]] == 1)
+                    queue.push_back(slot[j]);
+            }
+        }
+        if (order.size() == n)
+            break;
+    }
+    if (seed > 0xffff)
+        return false;
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        xorSlots(it->first, slot);
+        setFp(it->second, fingerprint(it->first) ^ getFp(slot[0]) ^ getFp(slot[1]) ^ getFp(slot[2]));
     }
     return true;
 }
+
+bool bloom::search(uint64_t key) const {
+    uint64_t h[2];
+    hash(key, h);
+    return search(h);
+}
+
+bool bloom::search(const uint64_t *hash) const {
+    if (!blocked) {
+        for (int i = 0; i < 4; ++i) {
+            uint32_t p = word(hash, i) % (8 * M);
+            if (!(words[p >> 6] >> (p & 63) & 1))
+                return false;
+        }
+        return true;
+    }
+    if (words.empty() || !pending.empty())
+        return true; // 还没有 build，不能排除
+    if (kind == FILTER_XOR) {
+        uint64_t x = mix(hash[0], seed);
+        uint32_t slot[3];
+        xorSlots(x, slot);
+        return fingerprint(x) == (getFp(slot[0]) ^ getFp(slot[1]) ^ getFp(slot[2]));
+    }
+    uint64_t mask[8];
+    lineMask(word(hash, 1), probes, mask);
+    const uint64_t *cur = &words[lineAt(word(hash, 0))];
+    uint64_t miss       = 0;
+    for (int w = 0; w < 8; ++w)
+        miss |= mask[w] & ~cur[w];
+    return !miss;
+}
+
+uint32_t bloom::size() const {
+    return blocked ? words.size() * 8 + 4 : M;
+}
+
+void bloom::dumpBytes(unsigned char *buf) const {
+    std::memcpy(buf, words.data(), words.size() * 8);
+    if (!blocked)
+        return;
+    unsigned char trailer[4] = {(unsigned char)probes, (unsigned char)kind, (unsigned char)seed,
+                                (unsigned char)(seed >> 8)};
+    std::memcpy(buf + words.size() * 8, trailer, 4);
+}
+
+void bloom::loadBytes(const unsigned char *buf, uint32_t len) {
+    pending.clear();
+    if (len == M) {
+        reset();
+        std::memcpy(words.data(), buf, M);
+        return;
+    }
+    blocked = true;
+    words.assign((len - 4) / 8, 0);
+    std::memcpy(words.data(), buf, words.size() * 8);
+    probes = buf[len - 4];
+    kind   = buf[len - 3];
+    seed   = buf[len - 2] | buf[len - 1] << 8;
+}
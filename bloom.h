@@ -2,44 +2,80 @@
 #define LSM_KV_BLOOM_H
 #include "MurmurHash3.h"
 
-#include <bitset>
+#include <cstddef>
 #include <cstdint>
-const uint32_t M = 10240;
+#include <vector>
+const uint32_t M                    = 10240; // 旧布局固定的字节数
+const uint32_t CACHE_LINE           = 64;
+const uint32_t DEFAULT_BITS_PER_KEY = 10;
 
-class bloom {
-private:
-    std::bitset<8 * M> s;
-    uint32_t hashV[4];
+enum filterKind {
+    FILTER_BLOOM = 0, // 分块 bloom，bitsPerKey 可以任意取
+    FILTER_XOR   = 1, // xor filter，只能整体构建；指纹 8 位（约 9.9 bits/key）或 16 位（约 19.7 bits/key），
+                      // bitsPerKey < 9 时放不下 8 位指纹，退回 bloom；>= 18 时用 16 位
+};
 
-public:
-    bloom() {}
+// 一张表的过滤器类型和大小，可以每层不同
+struct filterPolicy {
+    uint32_t kind       = FILTER_BLOOM;
+    uint32_t bitsPerKey = DEFAULT_BITS_PER_KEY;
 
-    ~bloom() {
-        s.reset();
-    }
+    filterPolicy() {}
 
-    void reset() {
-        s.reset();
+    filterPolicy(uint32_t kind, uint32_t bitsPerKey) {
+        this->kind       = kind;
+        this->bitsPerKey = bitsPerKey;
     }
+};
 
-    void setBitset(std::bitset<8 * M> t) {
-        s = t;
-    }
+/*
+ * sstable 的过滤器，三种布局：
+ * - 旧布局：固定 M 字节，4 个探测位散落在整个位图中。旧格式和早期块格式的文件使用。
+ * - 分块 bloom：位图按 64 字节的 cache line 切分，一个 key 的所有探测位都落在同一行，查找只访问一个 cache line，
+ *   探测时先拼出 8 个 64 位的掩码再与整行比较，没有分支。大小为 key 数 * bitsPerKey 向上取整到整行。
+ * - xor filter：三段指纹数组，key 映射到每段一个位置，三个指纹的异或等于 key 的指纹时认为存在；
+ *   同样的误判率下比 bloom 省约 30% 的空间，但必须在所有 key 已知时一次构建，正好适合写完即不再修改的 sstable。
+ * 后两种布局之后是 4 字节的 trailer [probes 或指纹位数 u8][kind u8][seed u16]，数组按 64 字节取整，
+ * 总长度为 64n + 4，不会等于 M，加载时据此区分旧布局。
+ * 后两种布局在 build 之前只记录每个 key 的哈希，所有 key 加入之后再按 key 数分配空间。
+ */
+class bloom {
+private:
+    std::vector<uint64_t> words; // 位图 / 指纹数组，按小端序与文件中的字节一一对应
+    bool blocked    = false;     // 不是旧布局
+    uint32_t kind   = FILTER_BLOOM;
+    uint32_t probes = 4;         // bloom 的探测位数，xor 的指纹位数
+    uint32_t seed   = 0;         // xor 构建成功时用的种子
+    filterPolicy policy;
+    std::vector<uint64_t> pending; // build 之前记下的哈希
 
-    std::bitset<8 * M> getBitset() {
-        return s;
-    }
+    size_t lineAt(uint32_t h) const; // 哈希落在的 cache line 在 words 中的起点
+    static void lineMask(uint32_t h, uint32_t probes, uint64_t *mask);
+    void buildBloom();
+    bool buildXor(); // 种子都试过仍然失败时返回 false
+    uint32_t segment() const;
+    void xorSlots(uint64_t h, uint32_t *slot) const;
+    uint32_t fingerprint(uint64_t h) const;
+    uint32_t getFp(uint32_t i) const;
+    void setFp(uint32_t i, uint32_t fp);
 
-    bool getBit(uint32_t p) {
-        return s[p];
+public:
+    bloom() {
+        reset();
     }
 
-    void setBit(uint32_t p) {
-        s[p] = true;
-    }
+    void reset();                     // 旧布局，全 0
+    void reset(filterPolicy policy);  // 之后 insert 所有 key 再 build
 
+    static void hash(uint64_t key, uint64_t *hash); // 128 位哈希值，批量查找时每个 key 只算一次
     void insert(uint64_t key);
-    bool search(uint64_t key);
+    void build(); // 按已加入的 key 数分配空间并构建
+    bool search(uint64_t key) const;
+    bool search(const uint64_t *hash) const;
+
+    uint32_t size() const;                                  // 写入文件的字节数
+    void dumpBytes(unsigned char *buf) const;               // 按文件中的位序导出 size() 个字节
+    void loadBytes(const unsigned char *buf, uint32_t len); // 长度为 M 时按旧布局恢复
 };
 
 #endif // LSM_KV_BLOOM_H
@@ -0,0 +1,95 @@
+#include "hashmemtable.h"
+
+#include <algorithm>
+#include <limits>
+#include <new>
+
+void hashmemtable::init() {
+    size_t cnt = size_t(1) << HASH_MEMTABLE_BITS;
+    buckets    = reinterpret_cast<std::atomic<hnode *> *>(mem.allocate(sizeof(std::atomic<hnode *>) * cnt));
+    for (size_t i = 0; i < cnt; ++i)
+        new (&buckets[i]) std::atomic<hnode *>(nullptr);
+}
+
+// 乘法哈希取高位，连续的 key 分散到不同的桶
+std::atomic<hashmemtable::hnode *> &hashmemtable::bucket(uint64_t key) const {
+    return buckets[(key * 0x9E3779B97F4A7C15ULL) >> (64 - HASH_MEMTABLE_BITS)];
+}
+
+hashmemtable::hnode *hashmemtable::find(hnode *head, uint64_t key) {
+    for (; head; head = head->next.load(std::memory_order_acquire)) {
+        if (head->key == key)
+            return head;
+    }
+    return nullptr;
+}
+
+int64_t hashmemtable::upsert(uint64_t key, std::string_view val) {
+    const char *rec         = newValue(val);
+    std::atomic<hnode *> &b = bucket(key);
+    hnode *head             = b.load(std::memory_order_acquire);
+    hnode *node             = nullptr;
+    while (true) {
+        if (hnode *found = find(head, key)) // 已经有这个 key（可能是别的线程刚插入的），只替换 value
+            return account(found->val.exchange(rec, std::memory_order_acq_rel), rec);
+        if (!node) {
+            node      = new (mem.allocate(sizeof(hnode))) hnode;
+            node->key = key;
+            node->val.store(rec, std::memory_order_relaxed);
+        }
+        node->next.store(head, std::memory_order_relaxed);
+        if (b.compare_exchange_strong(head, node, std::memory_order_release, std::memory_order_acquire))
+            break;
+    }
+    return account(nullptr, rec);
+}
+
+std::string hashmemtable::search(uint64_t key) {
+    hnode *node = find(bucket(key).load(std::memory_order_acquire), key);
+    return node ? std::string(view(node->val.load(std::memory_order_acquire))) : "";
+}
+
+bool hashmemtable::del(uint64_t key) {
+    hnode *node = find(bucket(key).load(std::memory_order_acquire), key);
+    if (!node)
+        return false;
+    const char *old = node->val.exchange(nullptr, std::memory_order_acq_rel);
+    account(old, nullptr);
+    return old != nullptr;
+}
+
+void hashmemtable::removeRange(uint64_t key1, uint64_t key2) {
+    for (size_t i = 0; i < (size_t(1) << HASH_MEMTABLE_BITS); ++i) {
+        for (hnode *node = buckets[i].load(std::memory_order_acquire); node;
+             node        = node->next.load(std::memory_order_acquire)) {
+            if (node->key >= key1 && node->key <= key2)
+                account(node->val.exchange(nullptr, std::memory_order_acq_rel), nullptr);
+        }
+    }
+}
+
+void hashmemtable::collect(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, const char *>> &list) const {
+    for (size_t i = 0; i < (size_t(1) << HASH_MEMTABLE_BITS); ++i) {
+        for (hnode *node = buckets[i].load(std::memory_order_acquire); node;
+             node        = node->next.load(std::memory_order_acquire)) {
+            const char *rec = node->val.load(std::memory_order_acquire);
+            if (rec && node->key >= key1 && node->key <= key2)
+                list.emplace_back(node->key, rec);
+        }
+    }
+    std::sort(list.begin(), list.end());
+}
+
+void hashmemtable::scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) {
+    std::vector<std::pair<uint64_t, const char *>> found;
+    collect(key1, key2, found);
+    for (auto &it : found)
+        list.emplace_back(it.first, std::string(view(it.second)));
+}
+
+void hashmemtable::forEach(const memtableVisitor &visit) {
+    std::vector<std::pair<uint64_t, const char *>> found;
+    collect(0, std::numeric_limits<uint64_t>::max(), found);
+    for (auto &it : found)
+        visit(it.first, view(it.second));
+}
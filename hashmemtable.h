@@ -0,0 +1,45 @@
+#pragma once
+
+#ifndef LSM_KV_HASHMEMTABLE_H
+#define LSM_KV_HASHMEMTABLE_H
+
+#include "memtable.h"
+
+const uint32_t HASH_MEMTABLE_BITS = 16; // 桶数为 2^16，一个写满的 memtable 平均每个桶一两个 key
+
+/*
+ * 哈希 memtable，适合点查为主的负载：key 按哈希分到固定数量的桶中，每个桶是一条单链表，
+ * get 只走一条短链表。插入用 CAS 挂到链表头，读者不加锁；节点不会摘下，删除只把 value 置空。
+ * key 在桶之间无序，scan 和落盘时先收集再排序。
+ */
+class hashmemtable : public memtable {
+private:
+    struct hnode {
+        uint64_t key;
+        std::atomic<const char *> val; // 为空表示已删除
+        std::atomic<hnode *> next;
+    };
+
+    std::atomic<hnode *> *buckets = nullptr; // 从 arena 中分配
+
+    std::atomic<hnode *> &bucket(uint64_t key) const;
+    static hnode *find(hnode *head, uint64_t key);
+    void collect(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, const char *>> &list) const; // 按 key 排序
+
+protected:
+    void init() override;
+    void removeRange(uint64_t key1, uint64_t key2) override;
+
+public:
+    hashmemtable() {
+        init();
+    }
+
+    int64_t upsert(uint64_t key, std::string_view val) override;
+    std::string search(uint64_t key) override;
+    bool del(uint64_t key) override;
+    void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) override;
+    void forEach(const memtableVisitor &visit) override;
+};
+
+#endif // LSM_KV_HASHMEMTABLE_H
@@ -0,0 +1,253 @@
+#include "iterator.h"
+
+static const std::string DEL = "~DELETED~"; // 与 kvstore.cc 中 del 写入的删除标记相同
+
+tableIterator::tableIterator(HeadRef head, blockReader read, uint64_t start) : head(head), read(std::move(read)) {
+    seek(start);
+}
+
+int tableIterator::chunks() {
+    if (!head->ensureLoaded())
+        return 0; // index 读不出来时当作空表
+    return head->getFormat() == FORMAT_BLOCK ? head->getBlockCnt() : head->getCnt();
+}
+
+// 旧格式的 value 连续存放在 index 之后，第 i 个 value 的结束位置为 getOffset(i)
+uint32_t tableIterator::begin(int i) {
+    if (head->getFormat() == FORMAT_BLOCK)
+        return head->getBlock(i).offset;
+    return 32 + 10240 + 12 * head->getCnt() + head->getOffset(i - 1);
+}
+
+uint32_t tableIterator::end(int i) {
+    if (head->getFormat() == FORMAT_BLOCK) {
+        BlockHandle handle = head->getBlock(i);
+        return handle.offset + handle.size;
+    }
+    return 32 + 10240 + 12 * head->getCnt() + head->getOffset(i);
+}
+
+void tableIterator::load(int from, int to) {
+    kvs.clear();
+    std::string buf;
+    uint32_t base = begin(from);
+    if (!read(head->getFilename(), base, end(to - 1) - base, buf))
+        return; // 读不出数据的一段直接跳过
+    for (int i = from; i < to; ++i) {
+        if (head->getFormat() == FORMAT_BLOCK)
+            block::decode(buf.data() + begin(i) - base, end(i) - begin(i), kvs);
+        else
+            kvs.emplace_back(head->getKey(i), buf.substr(begin(i) - base, end(i) - begin(i)));
+    }
+}
+
+void tableIterator::readForward() {
+    int n = chunks();
+    kvs.clear();
+    pos = 0;
+    while (kvs.empty() && last < n) {
+        first         = last;
+        uint32_t base = begin(first);
+        for (last = first + 1; last < n && end(last) - base <= readahead; ++last) {
+        }
+        load(first, last);
+        readahead = std::min(readahead * 2, MAX_READAHEAD);
+    }
+}
+
+void tableIterator::readBackward() {
+    kvs.clear();
+    while (kvs.empty() && first > 0) {
+        last           = first;
+        uint32_t limit = end(last - 1);
+        for (first = last - 1; first > 0 && limit - begin(first - 1) <= readahead; --first) {
+        }
+        load(first, last);
+        readahead = std::min(readahead * 2, MAX_READAHEAD);
+    }
+    pos = kvs.empty() ? 0 : kvs.size() - 1;
+}
+
+void tableIterator::next() {
+    if (++pos == kvs.size())
+        readForward();
+}
+
+void tableIterator::prev() {
+    if (pos)
+        pos--;
+    else
+        readBackward();
+}
+
+void tableIterator::seek(uint64_t key) {
+    readahead = BLOCK_SIZE; // 随机定位之后重新从一个块开始预读
+    first = last = head->getFormat() == FORMAT_BLOCK ? head->lowerBoundBlock(key) : head->lowerBound(key);
+    readForward();
+    while (valid() && this->key() < key)
+        next();
+}
+
+void tableIterator::seekToLast() {
+    readahead = BLOCK_SIZE;
+    first = last = chunks();
+    readBackward();
+}
+
+mergingIterator::mergingIterator(std::vector<std::unique_ptr<kvIterator>> children) : children(std::move(children)) {
+    rebuild(); // children 已经定位好
+}
+
+// 正向时 key 小的在堆顶，反向时 key 大的在堆顶；key 相同时都是下标小的在堆顶
+bool mergingIterator::lower(int a, int b) const {
+    uint64_t ka = children[a]->key(), kb = children[b]->key();
+    if (ka != kb)
+        return forward ? ka > kb : ka < kb;
+    return a > b;
+}
+
+void mergingIterator::rebuild() {
+    auto cmp = [this](int a, int b) { return lower(a, b); };
+    heap.clear();
+    for (int i = 0; i < (int)children.size(); ++i) {
+        if (children[i]->valid())
+            heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), cmp);
+    cur = heap.empty() ? -1 : heap.front();
+}
+
+void mergingIterator::step() {
+    auto cmp     = [this](int a, int b) { return lower(a, b); };
+    uint64_t key = children[cur]->key();
+    while (!heap.empty() && children[heap.front()]->key() == key) {
+        int i = heap.front();
+        std::pop_heap(heap.begin(), heap.end(), cmp);
+        heap.pop_back();
+        if (forward)
+            children[i]->next();
+        else
+            children[i]->prev();
+        if (children[i]->valid()) {
+            heap.push_back(i);
+            std::push_heap(heap.begin(), heap.end(), cmp);
+        }
+    }
+    cur = heap.empty() ? -1 : heap.front();
+}
+
+void mergingIterator::next() {
+    if (!forward) { // 所有 child 定位到当前 key 之后
+        uint64_t key = this->key();
+        forward      = true;
+        for (auto &it : children) {
+            it->seek(key);
+            if (it->valid() && it->key() == key)
+                it->next();
+        }
+        rebuild();
+        return;
+    }
+    step();
+}
+
+void mergingIterator::prev() {
+    if (forward) { // 所有 child 定位到当前 key 之前
+        uint64_t key = this->key();
+        forward      = false;
+        for (auto &it : children) {
+            it->seek(key);
+            if (it->valid())
+                it->prev();
+            else
+                it->seekToLast();
+        }
+        rebuild();
+        return;
+    }
+    step();
+}
+
+void mergingIterator::seek(uint64_t key) {
+    forward = true;
+    for (auto &it : children)
+        it->seek(key);
+    rebuild();
+}
+
+void mergingIterator::seekToLast() {
+    forward = false;
+    for (auto &it : children)
+        it->seekToLast();
+    rebuild();
+}
+
+dbIterator::dbIterator(VersionRef v, std::vector<std::unique_ptr<kvIterator>> children,
+                       std::vector<std::pair<int, rangedel>> dels, uint64_t lo, uint64_t hi, valueReader readValue,
+                       int firstTable)
+    : v(std::move(v)), merged(std::move(children)), dels(std::move(dels)), lo(lo), hi(hi),
+      readValue(std::move(readValue)), firstTable(firstTable) {
+    skipForward(); // children 已经定位到 lo
+}
+
+const std::string &dbIterator::value() const {
+    const std::string &val = merged.value();
+    if (!readValue || merged.source() < firstTable || !vlog::isPointer(val))
+        return val;
+    if (val != lastPtr) {
+        lastPtr = val;
+        if (!readValue(val, lastVal))
+            lastVal.clear();
+    }
+    return lastVal;
+}
+
+// 当前 key 是删除标记，或者被比它新的一路（下标更小）的范围删除覆盖
+bool dbIterator::hidden() const {
+    const std::string &val = merged.value();
+    if (!val.length() || val == DEL)
+        return true;
+    for (auto &it : dels) {
+        if (it.first < merged.source() && it.second.covers(merged.key()))
+            return true;
+    }
+    return false;
+}
+
+void dbIterator::skipForward() {
+    while (merged.valid() && merged.key() <= hi && hidden())
+        merged.next();
+}
+
+void dbIterator::skipBackward() {
+    while (merged.valid() && merged.key() >= lo && hidden())
+        merged.prev();
+}
+
+void dbIterator::next() {
+    merged.next();
+    skipForward();
+}
+
+void dbIterator::prev() {
+    merged.prev();
+    skipBackward();
+}
+
+void dbIterator::seek(uint64_t key) {
+    merged.seek(std::max(key, lo));
+    skipForward();
+}
+
+void dbIterator::seekToLast() {
+    if (hi == UINT64_MAX) {
+        merged.seekToLast();
+    } else { // 最后一个 <= hi 的 key
+        merged.seek(hi + 1);
+        if (merged.valid())
+            merged.prev();
+        else
+            merged.seekToLast();
+    }
+    skipBackward();
+}
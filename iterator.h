@@ -0,0 +1,211 @@
+#pragma once
+
+#ifndef LSM_KV_ITERATOR_H
+#define LSM_KV_ITERATOR_H
+
+#include "block.h"
+#include "rangedel.h"
+#include "version.h"
+#include "vlog.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 按 key 有序遍历 (key, value)，可以双向移动
+class kvIterator {
+public:
+    virtual ~kvIterator() {}
+
+    virtual bool valid() const               = 0;
+    virtual uint64_t key() const             = 0;
+    virtual const std::string &value() const = 0;
+    virtual void next()                      = 0;
+    virtual void prev()                      = 0; // 移过第一个 key 之后 valid 为 false
+    virtual void seek(uint64_t key)          = 0; // 定位到第一个 >= key 的 key
+    virtual void seekToLast()                = 0;
+};
+
+// 遍历已经排好序的 (key, value)，用于 memtable 中取出的一段数据
+class vectorIterator : public kvIterator {
+private:
+    std::vector<std::pair<uint64_t, std::string>> kvs;
+    size_t pos = 0;
+
+public:
+    vectorIterator(std::vector<std::pair<uint64_t, std::string>> kvs) : kvs(std::move(kvs)) {}
+
+    bool valid() const override {
+        return pos < kvs.size();
+    }
+
+    uint64_t key() const override {
+        return kvs[pos].first;
+    }
+
+    const std::string &value() const override {
+        return kvs[pos].second;
+    }
+
+    void next() override {
+        pos++;
+    }
+
+    void prev() override {
+        pos = pos ? pos - 1 : kvs.size();
+    }
+
+    void seek(uint64_t key) override {
+        pos = std::lower_bound(kvs.begin(), kvs.end(), key,
+                               [](const std::pair<uint64_t, std::string> &kv, uint64_t key) { return kv.first < key; }) -
+              kvs.begin();
+    }
+
+    void seekToLast() override {
+        pos = kvs.size() ? kvs.size() - 1 : 0;
+    }
+};
+
+// 从文件 offset 处读 len 字节到 buf，读满返回 true
+using blockReader = std::function<bool(const std::string &file, uint32_t offset, uint32_t len, std::string &buf)>;
+// 按 value log 指针读出 value，读到返回 true
+using valueReader = std::function<bool(const std::string &ptr, std::string &val)>;
+
+const uint32_t MAX_READAHEAD = 256 * 1024; // 顺序读时一次最多读入的字节数
+
+/*
+ * 遍历一个 sstable，内存中只保留最近读入的一段块（旧格式为一段 value）。
+ * 定位之后先读一个块，同一方向上每继续读一次，读入的字节数翻倍，直到 MAX_READAHEAD；
+ * 长的顺序遍历变成少量的大块顺序读，而内存占用有上限。
+ * 读文件的方式由调用者决定：compaction 和迭代器直接走 tablecache，不把缓存中的热块挤出去。
+ */
+class tableIterator : public kvIterator {
+private:
+    HeadRef head;
+    blockReader read;
+    int first = 0, last = 0;       // kvs 中是第 [first, last) 个块的数据，旧格式为 key 下标
+    uint32_t readahead = BLOCK_SIZE; // 下一次读入的字节数
+    std::vector<std::pair<uint64_t, std::string>> kvs;
+    size_t pos = 0;
+
+    int chunks();             // 块数，旧格式为 key 数
+    uint32_t begin(int i);    // 第 i 块在文件中的起止位置
+    uint32_t end(int i);
+    void load(int from, int to); // 一次读入 [from, to) 并解码到 kvs
+    void readForward();          // 读入 last 之后的一段
+    void readBackward();         // 读入 first 之前的一段
+
+public:
+    tableIterator(HeadRef head, blockReader read, uint64_t start = 0); // 从第一个 >= start 的 key 开始
+
+    bool valid() const override {
+        return pos < kvs.size();
+    }
+
+    uint64_t key() const override {
+        return kvs[pos].first;
+    }
+
+    const std::string &value() const override {
+        return kvs[pos].second;
+    }
+
+    void next() override;
+    void prev() override;
+    void seek(uint64_t key) override;
+    void seekToLast() override;
+};
+
+/*
+ * k 路归并：children 按优先级从高到低给出（下标越小越新），同一个 key 只输出优先级最高的那个，
+ * 其余的直接跳过。堆中每个 child 只占一项，next / prev 的代价为 O(log k)。
+ * 换向时所有 child 重新定位到当前 key 的另一侧，堆按新的方向重建。
+ */
+class mergingIterator : public kvIterator {
+private:
+    std::vector<std::unique_ptr<kvIterator>> children;
+    std::vector<int> heap; // 有效的 child 下标，堆顶为当前 key
+    bool forward = true;
+    int cur = -1;
+
+    bool lower(int a, int b) const; // 堆的比较函数：a 排在 b 后面
+    void rebuild();
+    void step(); // 当前 key 的所有版本一起沿当前方向移动
+
+public:
+    mergingIterator(std::vector<std::unique_ptr<kvIterator>> children);
+
+    bool valid() const override {
+        return cur != -1;
+    }
+
+    uint64_t key() const override {
+        return children[cur]->key();
+    }
+
+    const std::string &value() const override {
+        return children[cur]->value();
+    }
+
+    int source() const { // 当前 key 来自哪个 child
+        return cur;
+    }
+
+    void next() override;
+    void prev() override;
+    void seek(uint64_t key) override;
+    void seekToLast() override;
+};
+
+/*
+ * KVStore::newIterator 返回的迭代器：在 mergingIterator 之上跳过删除标记和被较新的一路的范围删除覆盖的 key，
+ * 只输出 [lo, hi] 内的 key。创建时复制 memtable、持有当时的 version，之后的写入和 compaction 对它不可见。
+ */
+class dbIterator : public kvIterator {
+private:
+    VersionRef v; // 遍历期间表头和文件不会被删除
+    mergingIterator merged;
+    std::vector<std::pair<int, rangedel>> dels; // 各路的范围删除，first 为所在的路
+    uint64_t lo, hi;
+    valueReader readValue;                      // 为空时不解析 value log 指针
+    int firstTable;                             // 之前的各路是 memtable，其中的 value 不是指针
+    mutable std::string lastPtr, lastVal;       // 最近一次解析的指针和 value
+
+    bool hidden() const;
+    void skipForward();
+    void skipBackward();
+
+public:
+    dbIterator(VersionRef v, std::vector<std::unique_ptr<kvIterator>> children,
+               std::vector<std::pair<int, rangedel>> dels, uint64_t lo, uint64_t hi, valueReader readValue = nullptr,
+               int firstTable = 0);
+
+    bool valid() const override {
+        return merged.valid() && merged.key() >= lo && merged.key() <= hi;
+    }
+
+    uint64_t key() const override {
+        return merged.key();
+    }
+
+    const std::string &value() const override; // value log 中的 value 在这里读出
+
+    const std::string &rawValue() const { // 表中存放的 value，可能是 value log 指针
+        return merged.value();
+    }
+
+    void seekToFirst() {
+        seek(lo);
+    }
+
+    void next() override;
+    void prev() override;
+    void seek(uint64_t key) override;
+    void seekToLast() override;
+};
+
+#endif // LSM_KV_ITERATOR_H
@@ -1,10 +1,14 @@
 #include "kvstore.h"
 
-#include "skiplist.h"
+#include "memtable.h"
 #include "sstable.h"
 #include "utils.h"
+#include "iterator.h"
+#include "tablebuilder.h"
+#include "vlog.h"
 #include "hnsw.h"
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
 #include <queue>
@@ -20,6 +24,11 @@
 namespace fs = std::filesystem;
 static const std::string DEL = "~DELETED~";
 const uint32_t MAXSIZE       = 2 * 1024 * 1024;
+const size_t MAX_MEMTABLE_MEMORY = 4 * MAXSIZE; // memtable 的 arena 占用上限
+const int L0_SLOWDOWN_TRIGGER = 8;    // level 0 的文件数达到这个值时开始延迟写入
+const int L0_STOP_TRIGGER     = 12;   // 达到这个值时写入等待 compaction
+const int SLOWDOWN_DELAY      = 1000; // us，每超出一个文件多延迟这么久
+const int FLUSH_RETRY_DELAY   = 1000; // ms，落盘失败之后隔这么久重试
 
 
 
@@ -48,26 +57,98 @@ struct cmpPoi {
 
 
 
-KVStore::KVStore(const std::string &dir) :hnsw_index(8,16,25,9,dim),
-    KVStoreAPI(dir) // read from sstables
+KVStore::KVStore(const std::string &dir, size_t cacheCapacity, bool lazyLoad) :hnsw_index(8,16,25,9,dim),
+    KVStoreAPI(dir), blockCache(cacheCapacity) // read from sstables
 {
-    
-    for (totalLevel = 0;; ++totalLevel) {
-        std::string path = dir + "/level-" + std::to_string(totalLevel) + "/";
-        std::vector<std::string> files;
-        if (!utils::dirExists(path)) {
-            totalLevel--;
-            break; // stop read
+    std::vector<std::vector<std::string>> files(MAX_LEVELS);
+    dataDir      = dir;
+    manifestPath = dir + "/MANIFEST";
+    bool recovered = manifest::recover(manifestPath, files);
+    std::vector<std::vector<std::string>> live(MAX_LEVELS);
+    auto init  = std::make_shared<version>();
+    totalLevel = -1;
+    // 表头在线程池中并行读取；lazyLoad 时只读 header / footer，bloom 和 index 第一次查找时再读
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::vector<std::future<HeadRef>>> heads(MAX_LEVELS);
+    for (int level = 0; level < MAX_LEVELS; ++level) {
+        std::string path = levelPath(level) + "/";
+        std::vector<std::string> names;
+        if (utils::dirExists(path))
+            utils::scanDir(path, names);
+        if (!recovered) { // 旧目录没有 MANIFEST，扫描一次目录，之后写出快照
+            for (auto &name : names)
+                files[level].push_back(path + name);
+        } else { // 不在 MANIFEST 中的文件是 compaction 中途崩溃留下的，删除
+            for (auto &name : names) {
+                bool found = false;
+                for (auto &url : files[level])
+                    found |= url.substr(url.rfind('/') + 1) == name;
+                if (!found)
+                    utils::rmfile((path + name).data());
+            }
+        }
+        for (auto &url : files[level]) { // 读每一个文件头
+            heads[level].push_back(pool.submit([url, lazyLoad] {
+                auto cur = std::make_shared<sstablehead>();
+                return cur->loadFileHead(url.data(), lazyLoad) ? cur : nullptr;
+            }));
+            live[level].push_back(url);
         }
-        int nums = utils::scanDir(path, files);
-        sstablehead cur;
-        for (int i = 0; i < nums; ++i) {       // 读每一个文件头
-            std::string url = path + files[i]; // url, 每一个文件名
-            cur.loadFileHead(url.data());
-            sstableIndex[totalLevel].push_back(cur);
-            TIME = std::max(TIME, cur.getTime()); // 更新时间戳
+    }
+    for (int level = 0; level < MAX_LEVELS; ++level) {
+        for (auto &it : heads[level]) {
+            HeadRef cur = it.get();
+            if (!cur)
+                continue; // 打不开的表不装入 version，但仍留在 MANIFEST 中，不会被当作残留文件删除
+            init->levels[level].push_back(cur);
+            totalLevel = level;
+            TIME       = std::max(TIME.load(), cur->getTime()); // 更新时间戳
         }
     }
+    init->sortLevels();
+    if (!utils::dirExists(dir))
+        utils::mkdir(dir.data());
+    manifestLog.open(manifestPath, live);
+    valueLog.open(dir + "/vlog");
+    auto segments    = valueLog.segments();
+    installedSegment = segments.empty() ? 0 : segments.back(); // 打开时已有的段都已落盘完毕
+    // 上次退出前没有落盘的 memtable 从 WAL 中恢复：每个日志对应一个 memtable，按编号从旧到新交给后台落盘
+    walDir = dir;
+    std::vector<std::string> names;
+    std::vector<uint64_t> logs;
+    utils::scanDir(dir, names);
+    for (auto &name : names) {
+        if (name.size() > 4 && name.find_first_not_of("0123456789") == name.size() - 4 &&
+            name.substr(name.size() - 4) == ".log")
+            logs.push_back(std::stoull(name));
+    }
+    std::sort(logs.begin(), logs.end());
+    for (uint64_t no : logs) {
+        std::string log = dir + "/" + std::to_string(no) + ".log";
+        auto table      = newMemtable(memKind);
+        wal::replay(
+            log, [&table](uint64_t key, const std::string &val) { table->upsert(key, val); },
+            [&table](uint64_t start, uint64_t end) { table->delRange(start, end); });
+        if (table->getBytes())
+            imms.push_back({table, log});
+        else
+            utils::rmfile(log.data());
+        logNo = no;
+    }
+    walPath = dir + "/" + std::to_string(++logNo) + ".log";
+    walLog.open(walPath);
+    auto first = std::make_shared<snapshot>();
+    first->mems.push_back(s);
+    for (auto it = imms.rbegin(); it != imms.rend(); ++it)
+        first->mems.push_back(it->table);
+    first->v = init;
+    std::atomic_store(&snap, SnapshotRef(first));
+    l0Files         = init->levels[0].size();
+    pendingBytes    = estimatePendingBytes(*init);
+    compactRequests = 1; // 上次退出时可能还有没做完的 compaction
+    compactBusy     = true;
+    flusher         = std::thread(&KVStore::backgroundWork, this);
+    compactor       = std::thread(&KVStore::compactionWork, this);
     //需要修改这里的dir。
     // 冷启动（无数据）：使用默认参数创建新 HNSW 索引，并保存初始结构到磁盘。
     // 热启动（有数据）：从磁盘加载现有索引。
@@ -82,25 +163,200 @@ KVStore::KVStore(const std::string &dir) :hnsw_index(8,16,25,9,dim),
 
 KVStore::~KVStore()
 {
-    sstable ss(s);
-    if (!ss.getCnt())
+    std::unique_lock<std::mutex> writeGuard(writeLock);
+    bool dirty = s->getBytes() != 0;
+    if (dirty)
+        freezeMemtable(); // 交给后台线程落盘
+    writeGuard.unlock();
+    {
+        std::lock_guard<std::mutex> guard(bgLock);
+        bgStop = true;
+    }
+    bgCv.notify_all();
+    flusher.join(); // 落盘线程把 imms 全部落盘才退出，落盘失败的留在日志中
+    {
+        std::lock_guard<std::mutex> guard(bgLock);
+        compactStop = true;
+    }
+    compactCv.notify_all();
+    compactor.join(); // 做完所有超过目标的层才退出
+    walLog.close();
+    utils::rmfile(walPath.data()); // 新 memtable 是空的，日志也是空的
+    purgeObsolete(); // 不会再有读者持有旧 version
+    if (!dirty)
         return; // empty sstable
-    std::string path = std::string("./data/level-0/");
-    if (!utils::dirExists(path)) {
-        utils::_mkdir(path.data());
-        totalLevel = 0;
-    }
-    std::string filename = ss.getFilename();
-    std::cout << "Writing to file: " << filename << std::endl;
-    ss.putFile(ss.getFilename().data());
     //cache落入磁盘
     save_embedding_to_disk("./data/");
-    sstableIndex[0].push_back(ss.getHead());
-    compaction(); 
     // save_hnsw_index_to_disk("./hnsw_data_root/");
 
 }
 
+void KVStore::freezeMemtable() {
+    std::unique_lock<std::mutex> guard(bgLock);
+    idleCv.wait(guard, [this] { return imms.size() < maxImmutables; }); // 后台落盘跟不上时阻塞写者
+    imms.push_back({s, walPath});
+    s       = newMemtable(memKind);
+    walPath = walDir + "/" + std::to_string(++logNo) + ".log";
+    walLog.open(walPath); // 旧日志随 immutable memtable 落盘后删除
+    installSnapshot([this](snapshot &next) { next.mems.insert(next.mems.begin(), s); });
+    bgCv.notify_one();
+}
+
+/*
+ * 设置了内存预算时按 Monkey 的方式在各层之间分配 bitsPerKey：level i 最多约 2^(i+1) 个文件，
+ * 一次查找的期望 I/O 是各层误判率之和，误判率与该层 key 数成正比时最小，
+ * 即每浅一层多约 1/ln2 = 1.44 位。最深层的位数由总预算反推，各层至少 1 位。
+ */
+filterPolicy KVStore::policyFor(int level) const {
+    std::lock_guard<std::mutex> guard(policyLock);
+    filterPolicy policy = policies[level];
+    uint32_t budget     = filterBudget;
+    if (!budget)
+        return policy;
+    int deepest  = std::max({(int)totalLevel, level, 1});
+    double keys  = 0, extra = 0;
+    for (int i = 0; i <= deepest; ++i) {
+        keys += std::pow(2, i + 1);
+        extra += std::pow(2, i + 1) * 1.44 * (deepest - i);
+    }
+    double bits       = budget - extra / keys + 1.44 * (deepest - level);
+    policy.bitsPerKey = std::max(1.0, std::round(bits));
+    return policy;
+}
+
+// 表和它所在的目录都落盘之后才记入 MANIFEST、删除 WAL；任何一步失败都保留日志，返回 false 由调用者重试
+bool KVStore::flushImmutable(const Immutable &imm) {
+    vlog::writer values = valueLog.newWriter();
+    std::string path    = levelPath(0);
+    sstable ss(imm.table.get(), path, ++TIME, policyFor(0),
+               [&](uint64_t key, const std::string &val) { return separateValue(values, key, val); });
+    if (!values.finish()) // value 先于引用它们的表落盘
+        return false;
+    bool created = !utils::dirExists(path);
+    if (created && utils::mkdir(path.data()) != 0) {
+        std::perror(path.data());
+        return false;
+    }
+    // 加入磁盘，块格式在这一步生成 block index
+    if (!ss.putFile(ss.getFilename().data()) || utils::syncDir(path.data()) != 0 ||
+        (created && utils::syncDir(dataDir.data()) != 0)) {
+        utils::rmfile(ss.getFilename().data()); // 还没有记入 MANIFEST，重试时换新的文件名
+        return false;
+    }
+    addsstable(ss, 0); // 加入缓存，落盘并记入 MANIFEST 之后 WAL 中的记录不再需要
+    installedSegment = values.getSegment();
+    utils::rmfile(imm.log.data());
+    return true;
+}
+
+void KVStore::backgroundWork() {
+    std::unique_lock<std::mutex> guard(bgLock);
+    while (true) {
+        bgCv.wait(guard, [this] { return bgStop || !imms.empty(); });
+        if (imms.empty())
+            break; // 要退出且已经全部落盘
+        Immutable imm = imms.front();
+        bgBusy        = true;
+        guard.unlock();
+        bool flushed = flushImmutable(imm);
+        guard.lock();
+        if (!flushed) { // memtable 和日志都留着；要退出时不再重试，下次启动从日志恢复
+            bgBusy = false;
+            idleCv.notify_all();
+            if (bgStop)
+                break;
+            bgCv.wait_for(guard, std::chrono::milliseconds(FLUSH_RETRY_DELAY));
+            continue;
+        }
+        imms.pop_front(); // 表已经在 version 中，读者不会漏掉这部分数据
+        installSnapshot([&imm](snapshot &next) {
+            next.mems.erase(std::find(next.mems.begin(), next.mems.end(), imm.table));
+        });
+        bgBusy = false;
+        compactRequests++; // compaction 交给 compactor 线程
+        compactBusy = true;
+        compactCv.notify_one();
+        idleCv.notify_all();
+    }
+}
+
+void KVStore::waitForBackground() {
+    std::unique_lock<std::mutex> guard(bgLock);
+    idleCv.wait(guard, [this] { return imms.empty() && !bgBusy && !compactBusy; });
+}
+
+KVStore::SnapshotRef KVStore::getSnapshot() const {
+    return std::atomic_load(&snap);
+}
+
+// 只有 snapLock 串行化替换；各处修改的部分互不重叠：换 memtable 改 mems 头部，落盘改 mems 尾部，applyEdit 改 v
+void KVStore::installSnapshot(const std::function<void(snapshot &)> &edit) {
+    std::lock_guard<std::mutex> guard(snapLock);
+    auto next = std::make_shared<snapshot>(*getSnapshot());
+    edit(*next);
+    std::atomic_store(&snap, SnapshotRef(std::move(next)));
+}
+
+// 超过 2MB，或者反复覆盖使 arena 占用过多，换一个新的 memtable，写满的由后台线程落盘
+void KVStore::makeRoom(size_t need) {
+    uint32_t bytes = s->getBytes();
+    if (bytes && (bytes + need + 10240 + 32 > MAXSIZE || s->getMemoryUsage() > MAX_MEMTABLE_MEMORY))
+        freezeMemtable();
+}
+
+/*
+ * 写者排队，队首的线程作为 leader 把排在后面的写合并成一批（最多 WAL_MAX_BATCH 字节）：
+ * 一次写 WAL，再按排队顺序写 memtable，同一个 key 的写在 WAL 和 memtable 中顺序一致。
+ * 其余线程等 leader 写完直接返回；leader 写的时候新来的写者继续排队，组成下一批。
+ */
+void KVStore::write(writeOp &w) {
+    std::unique_lock<std::mutex> guard(queueLock);
+    writers.push_back(&w);
+    while (!w.done && writers.front() != &w)
+        w.cv.wait(guard);
+    if (w.done)
+        return;
+    size_t n = 0, need = 0;
+    for (; n < writers.size(); ++n) {
+        size_t bytes = writers[n]->range ? 16 : 12 + writers[n]->val.length();
+        if (n && need + bytes > WAL_MAX_BATCH)
+            break;
+        need += bytes;
+    }
+    std::vector<writeOp *> batch(writers.begin(), writers.begin() + n);
+    guard.unlock();
+    {
+        std::lock_guard<std::mutex> exclusive(writeLock);
+        makeRoom(need);
+        std::string recs;
+        recs.reserve(need + 8 * n);
+        for (writeOp *it : batch) {
+            if (it->range)
+                wal::encodeRange(recs, it->key, it->end);
+            else
+                wal::encode(recs, it->key, it->val);
+        }
+        walLog.appendBatch(recs); // 先写日志再写 memtable
+        for (writeOp *it : batch) {
+            if (it->range)
+                s->delRange(it->key, it->end);
+            else
+                s->upsert(it->key, it->val); // 一次查找完成插入或覆盖
+        }
+    }
+    guard.lock();
+    for (size_t i = 0; i < n; ++i) {
+        writeOp *it = writers.front();
+        writers.pop_front();
+        if (it != &w) {
+            it->done = true;
+            it->cv.notify_one();
+        }
+    }
+    if (!writers.empty()) // 唤醒下一批的 leader
+        writers.front()->cv.notify_one();
+}
+
 /**
  * Insert/Update the key-value pair.
  * No return values for simplicity.
@@ -141,84 +397,320 @@ KVStore::~KVStore()
 //现在要绕过embedding 直接根据val找到被embed好的向量
 void KVStore::put(uint64_t key, const std::string &val) {
     // std::vector<float> embeddingString = embedding_single(val);
-    std::vector<float> embeddingString = sentence2line[val];
-    Cache[key]= embeddingString;
+    auto found = sentence2line.find(val); // 不用 operator[]，多个写者并发查找时不会插入
+    {
+        std::lock_guard<std::shared_mutex> guard(cacheLock);
+        Cache[key] = found == sentence2line.end() ? std::vector<float>() : found->second;
+    }
     // dirty_keys.insert(key);
     // hnsw_index.insert(key, embeddingString);
+    writeValue(key, val);
+}
+
+// value 只按 string_view 读取，WAL 和 memtable 各复制一次，中间不经过临时的 std::string。
+// 按新 key 估算大小，覆盖旧值时偏大，只会让 memtable 略早一点冻结
+void KVStore::writeValue(uint64_t key, std::string_view val) {
+    throttleWrite();
+    writeOp w;
+    w.key = key;
+    w.val = val;
+    write(w);
+}
 
-    uint32_t nxtsize = s->getBytes();
-    std::string res  = s->search(key);
-    if (!res.length()) { // new add
-        nxtsize += 12 + val.length();
-    } else
-        nxtsize = nxtsize - res.length() + val.length(); // change string
-    if (nxtsize + 10240 + 32 <= MAXSIZE)
-       {
-        s->insert(key, val);
-       }  // 小于等于（不超过） 2MB
-    else {
-        sstable ss(s);
-        s->reset();
-        std::string url  = ss.getFilename();
-        std::string path = "./data/level-0";
-        if (!utils::dirExists(path)) {
-            utils::mkdir(path.data());
-            totalLevel = 0;
+// 从 level / pos 处开始找下一张 key 范围包含 key 的表，并把游标移到它之后；没有时返回 nullptr
+static HeadRef nextCandidate(const version &v, uint64_t key, int &level, int &pos) {
+    for (; level < MAX_LEVELS; ++level, pos = 0) {
+        if (level == 0) { // level 0 按时间戳从新到旧，逐张检查
+            while (pos < (int)v.levels[0].size()) {
+                const HeadRef &it = v.levels[0][pos++];
+                if (key >= it->getMinV() && key <= it->getMaxV())
+                    return it;
+            }
+        } else if (pos == 0) { // level >= 1 最多一张
+            pos   = 1;
+            int p = v.find(level, key);
+            if (p != -1)
+                return v.levels[level][p];
         }
-        addsstable(ss, 0);      // 加入缓存
-        ss.putFile(url.data()); // 加入磁盘
-        //这里可以写一下cache
-        compaction();
-        s->insert(key, val);
     }
+    return nullptr;
+}
 
+// 用预先算好的哈希在表中定位 key：块格式为所在的整个块，旧格式为 value 本身；bloom 不通过返回 false。
+// 调用前先用 ensureLoaded 确认 bloom 和 index 可用
+static bool locate(const HeadRef &it, uint64_t key, const uint64_t *hash, uint32_t &offset, uint32_t &len) {
+    if (it->getFormat() == FORMAT_BLOCK) {
+        int b = it->searchBlock(key, hash);
+        if (b < 0)
+            return false;
+        BlockHandle handle = it->getBlock(b);
+        offset             = handle.offset;
+        len                = handle.size;
+        return true;
+    }
+    int p = it->searchOffset(key, hash, len);
+    if (p < 0)
+        return false;
+    offset = p + 32 + 10240 + 12 * it->getCnt();
+    return true;
 }
+
 /**
  * Returns the (string) value of the given key.
  * An empty string indicates not found.
  */
 std::string KVStore::get(uint64_t key) //
 {
-    uint64_t time = 0;
-    int goalOffset;
-    uint32_t goalLen;
-    std::string goalUrl;
-    std::string res = s->search(key);
-    if (res.length()) { // 在memtable中找到, 或者是deleted，说明最近被删除过，
-                        // 不用查sstable
-        if (res == DEL)
-            return "";
+    // 从新到旧查找：先找到的值就是最新的；没找到但被这一处的范围删除覆盖，说明 key 已被删除
+    std::string res;
+    SnapshotRef cur = getSnapshot(); // memtable 和 version 一起取，持有期间不受换表、落盘和 compaction 影响
+    if (searchMemtables(cur->mems, key, res))
         return res;
+    if (searchTables(*cur->v, key, res) && vlog::isPointer(res)) {
+        std::string ptr = res;
+        if (!readValue(ptr, res))
+            res.clear();
     }
-    for (int level = 0; level <= totalLevel; ++level) {
-        for (sstablehead it : sstableIndex[level]) {
-            if (key < it.getMinV() || key > it.getMaxV())
-                continue;
-            uint32_t len; //当前 key 对应数据的长度
-            int offset = it.searchOffset(key, len); //前一个元素的 offset 就是当前元素数据的起始位置
-            if (offset == -1) {
-                if (!level)
-                    continue;
-                else
+    return res;
+}
+
+// 在 v 的各层表中查找 key，能确定结果时返回 true，val 为表中的值（已删除时为空串）。
+// 某张表的 bloom / index 读不出来时返回 false 且 val 为空串，不再查更旧的表：它们的值可能已被这张表覆盖
+bool KVStore::searchTables(const version &v, uint64_t key, std::string &val) {
+    uint64_t hash[2]; // memtable 不用 bloom，没找到时才算，之后每张表的 bloom 都用这一份
+    bloom::hash(key, hash);
+    int level = 0, pos = 0;
+    while (HeadRef it = nextCandidate(v, key, level, pos)) { // level 0 按时间戳从新到旧，level >= 1 二分出唯一的候选表
+        if (!it->ensureLoaded()) {
+            metaErrors++;
+            break;
+        }
+        if (searchTable(it, key, hash, val)) {
+            if (val == DEL)
+                val = "";
+            return true;
+        }
+        if (it->rangeDeleted(key)) {
+            val = "";
+            return true;
+        }
+    }
+    val = "";
+    return false;
+}
+
+// scan / compaction 按窗口顺序读：读这一段之前先提示内核预读紧接着的同样长度
+bool KVStore::readSequential(const std::string &file, uint32_t offset, uint32_t len, std::string &buf) {
+    tableCache.advise(file, offset + len, len);
+    return tableCache.read(file, offset, len, buf) == len;
+}
+
+// 不复制地取出表中 key 的值：mmap 模式下指向映射区，否则读入（经过 blockcache）lease 持有的缓冲区
+bool KVStore::pinTable(const HeadRef &it, uint64_t key, const uint64_t *hash, pinnedValue &val) {
+    uint32_t offset, len;
+    if (!locate(it, key, hash, offset, len))
+        return false;
+    if (!pinRange(it->getFilename(), offset, len, val))
+        return false;
+    return it->getFormat() != FORMAT_BLOCK || block::find(val.data.data(), val.data.size(), key, val.data);
+}
+
+bool KVStore::pinRange(const std::string &file, uint32_t offset, uint32_t len, pinnedValue &val) {
+    if (tableCache.isMmap())
+        return tableCache.view(file, offset, len, val.data, val.lease);
+    auto buf = std::make_shared<std::string>(fetchString(file, offset, len));
+    val.data  = *buf;
+    val.lease = buf;
+    return buf->length() == len;
+}
+
+/**
+ * 与 get 相同的查找，但不复制 value：mmap 模式下 data 直接指向映射区，lease 存在期间有效，
+ * 即使对应的表之后被 compaction 删除。memtable 中的 value 会被修改，只能复制一份。不存在时 data 为空。
+ */
+pinnedValue KVStore::getPinned(uint64_t key) {
+    pinnedValue res;
+    std::string val;
+    SnapshotRef cur = getSnapshot();
+    if (searchMemtables(cur->mems, key, val)) {
+        auto buf  = std::make_shared<std::string>(std::move(val));
+        res.data  = *buf;
+        res.lease = buf;
+        return res;
+    }
+    const VersionRef &v = cur->v;
+    uint64_t hash[2];
+    bloom::hash(key, hash);
+    int level = 0, pos = 0;
+    HeadRef it;
+    while ((it = nextCandidate(*v, key, level, pos))) {
+        if (!it->ensureLoaded()) {
+            metaErrors++;
+            return pinnedValue(); // 同 searchTables
+        }
+        if (pinTable(it, key, hash, res))
+            break;
+        if (it->rangeDeleted(key))
+            return pinnedValue();
+    }
+    valuePointer p;
+    if (!it || res.data == DEL)
+        return pinnedValue();
+    if (vlog::decode(res.data, p) && !pinRange(valueLog.path(p.segment), p.offset, p.len, res))
+        return pinnedValue();
+    return res;
+}
+
+bool KVStore::readValue(const std::string &ptr, std::string &val) {
+    valuePointer p;
+    if (!vlog::decode(ptr, p))
+        return false;
+    val = fetchString(valueLog.path(p.segment), p.offset, p.len);
+    return val.length() == p.len;
+}
+
+// 落盘时决定 value 是否写入 value log：删除标记留在表中，与指针同形的 value 无论长短都写入，避免被误认
+std::string KVStore::separateValue(vlog::writer &values, uint64_t key, const std::string &val) {
+    uint32_t threshold = vlogThreshold;
+    if (vlog::isPointer(val) || (threshold && val.length() >= threshold && val != DEL))
+        return values.append(key, val);
+    return val;
+}
+
+// 在 memtable 和 immutable memtable 中（mems 新的在前）查找 key，能确定结果时返回 true，val 为值（已删除时为空串）
+bool KVStore::searchMemtables(const std::vector<std::shared_ptr<memtable>> &mems, uint64_t key, std::string &val) {
+    for (auto &m : mems) {
+        val = m->search(key);
+        if (val.length()) { // 在memtable中找到, 或者是deleted，说明最近被删除过，不用查sstable
+            if (val == DEL)
+                val = "";
+            return true;
+        }
+        if (m->getRangeDels().covers(key))
+            return true;
+    }
+    return false;
+}
+
+// 在一张表中查找 key，找到时 val 为表中的值（可能是删除标记）
+bool KVStore::searchTable(const HeadRef &it, uint64_t key, const uint64_t *hash, std::string &val) {
+    uint32_t offset, len;
+    if (!locate(it, key, hash, offset, len))
+        return false;
+    if (it->getFormat() != FORMAT_BLOCK) {
+        val = fetchString(it->getFilename(), offset, len);
+        return true;
+    }
+    std::string blk = fetchString(it->getFilename(), offset, len);
+    return block::find(blk.data(), blk.size(), key, val); // bloom 误判时找不到
+}
+
+/**
+ * 批量查找，结果与 keys 一一对应，空串表示不存在。
+ * 每个 key 只算一次 bloom 哈希。每一轮中每个 key 找到下一张 bloom 通过的表，
+ * 所有读按文件分组，组内按 offset 排序，同一个块只读一次，不同文件的读在 readers 中并发；
+ * bloom 误判的 key 在下一轮继续查更旧的表。
+ */
+std::vector<std::string> KVStore::multiGet(const std::vector<uint64_t> &keys) {
+    struct Lookup {
+        size_t id; // 在 keys 中的下标
+        uint64_t hash[2];
+        int level = 0, pos = 0; // 下一张要查的表
+    };
+    struct Read {
+        HeadRef table;
+        uint32_t offset, len;
+        std::vector<Lookup *> waiters; // 等这次读的 key
+        std::string buf;
+    };
+    std::vector<std::string> res(keys.size());
+    std::vector<Lookup> lookups;
+    SnapshotRef cur     = getSnapshot(); // 所有 key 在同一个快照中查找
+    const VersionRef &v = cur->v;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (searchMemtables(cur->mems, keys[i], res[i]))
+            continue;
+        lookups.emplace_back();
+        lookups.back().id = i;
+        bloom::hash(keys[i], lookups.back().hash);
+    }
+    std::vector<Lookup *> active;
+    for (auto &it : lookups)
+        active.push_back(&it);
+    while (!active.empty()) {
+        std::map<std::string, std::map<uint32_t, Read>> reads; // 文件 -> offset -> 读
+        for (Lookup *l : active) {
+            uint64_t key = keys[l->id];
+            uint32_t offset, len;
+            HeadRef table;
+            while ((table = nextCandidate(*v, key, l->level, l->pos))) {
+                if (!table->ensureLoaded()) { // 同 searchTables，结果未知时不再查更旧的表
+                    metaErrors++;
+                    table = nullptr;
+                    break;
+                }
+                if (locate(table, key, l->hash, offset, len))
                     break;
+                if (table->rangeDeleted(key)) { // 被这张表的范围删除覆盖，不再查更旧的表
+                    table = nullptr;
+                    break;
+                }
             }
-            // sstable ss;
-            // ss.loadFile(it.getFilename().data());
-            if (it.getTime() > time) { // find the latest head
-                time       = it.getTime();
-                goalUrl    = it.getFilename();
-                goalOffset = offset + 32 + 10240 + 12 * it.getCnt();
-                goalLen    = len;
+            if (!table)
+                continue; // 不存在或已删除，res 保持空串
+            Read &r  = reads[table->getFilename()][offset];
+            r.table  = table;
+            r.offset = offset;
+            r.len    = len;
+            r.waiters.push_back(l);
+        }
+        auto readFile = [this](std::map<uint32_t, Read> &file) {
+            for (auto &it : file)
+                it.second.buf = fetchString(it.second.table->getFilename(), it.second.offset, it.second.len);
+        };
+        std::vector<std::future<void>> results; // 第一个文件在本线程读，其余的交给 readers
+        for (auto it = reads.begin(); it != reads.end(); ++it) {
+            if (it != reads.begin())
+                results.push_back(readers.submit([&readFile, &file = it->second] { readFile(file); }));
+        }
+        if (!reads.empty())
+            readFile(reads.begin()->second);
+        for (auto &it : results)
+            it.get();
+        active.clear();
+        for (auto &file : reads) {
+            for (auto &it : file.second) {
+                Read &r = it.second;
+                for (Lookup *l : r.waiters) {
+                    uint64_t key    = keys[l->id];
+                    std::string val = r.buf;
+                    if (r.table->getFormat() != FORMAT_BLOCK || block::find(r.buf.data(), r.buf.size(), key, val))
+                        res[l->id] = val == DEL ? "" : val;
+                    else if (!r.table->rangeDeleted(key))
+                        active.push_back(l); // bloom 误判，下一轮查更旧的表
+                }
             }
         }
-        if (time)
-            break; // only a test for found
     }
-    if (!goalUrl.length())
-        return ""; // not found a sstable
-    res = fetchString(goalUrl, goalOffset, goalLen);
-    if (res == DEL)
-        return "";
+    // 表中查到的 value log 指针按段分组，同样并发读出
+    std::map<uint64_t, std::vector<size_t>> separated;
+    for (auto &l : lookups) {
+        valuePointer p;
+        if (vlog::decode(res[l.id], p))
+            separated[p.segment].push_back(l.id);
+    }
+    std::vector<std::future<void>> values;
+    for (auto &it : separated) {
+        values.push_back(readers.submit([this, &res, &ids = it.second] {
+            for (size_t id : ids) {
+                std::string ptr = res[id];
+                if (!readValue(ptr, res[id]))
+                    res[id].clear();
+            }
+        }));
+    }
+    for (auto &it : values)
+        it.get();
     return res;
 }
 
@@ -229,6 +721,7 @@ std::string KVStore::get(uint64_t key) //
 bool KVStore::del(uint64_t key) {
     std::vector<float> embeddingString;
     uint64_t id;
+    std::unique_lock<std::shared_mutex> guard(cacheLock);
     for(auto &it:hnsw_index.nodes) {
         if(it.key == key) {
             it.is_deleted = true; // 标记为删除
@@ -240,6 +733,7 @@ bool KVStore::del(uint64_t key) {
     //是在落入磁盘的时候判断内存中是否还有这个key对应的向量 然后来判断是修改了还是删除，
     Cache.erase(key);  // 从内存移除
     dirty_keys.insert(key);  // 标记为删除
+    guard.unlock();
     std::string res = get(key);
     if (!res.length())
         return false; // not exist
@@ -247,23 +741,72 @@ bool KVStore::del(uint64_t key) {
     return true;
 }
 
+/**
+ * Delete all key-value pairs whose key lies in [key1, key2].
+ * 只写一条范围删除，不逐个 key 写删除标记；更旧的数据由 get / scan 过滤，compaction 时物理删除
+ */
+void KVStore::deleteRange(uint64_t key1, uint64_t key2) {
+    if (key1 > key2)
+        return;
+    // 向量索引和 embedding 缓存都在内存中，各遍历一次标记区间内的 key
+    std::unique_lock<std::shared_mutex> cacheGuard(cacheLock);
+    for (auto &it : hnsw_index.nodes) {
+        if (it.key >= key1 && it.key <= key2 && !it.is_deleted) {
+            it.is_deleted = true;
+            deleted_nodes.push_back(DeletedNode(it.id, it.vector));
+        }
+    }
+    for (auto it = Cache.begin(); it != Cache.end();) {
+        if (it->first >= key1 && it->first <= key2) {
+            dirty_keys.insert(it->first); // 标记为删除
+            it = Cache.erase(it);
+        } else
+            ++it;
+    }
+    cacheGuard.unlock();
+    throttleWrite();
+    writeOp w;
+    w.key   = key1;
+    w.end   = key2;
+    w.range = true;
+    write(w);
+}
+
 /**
  * This resets the kvstore. All key-value pairs should be removed,
  * including memtable and all sstables files.
  */
 void KVStore::reset() {
-    s->reset(); // 先清空memtable
-    std::vector<std::string> files;
+    std::lock_guard<std::mutex> guard(writeLock);
+    waitForBackground(); // 后台不再写文件之后再删
+    std::lock_guard<std::mutex> edit(editLock);
+    s = newMemtable(memKind); // 先换掉memtable，读者可能还持有旧的
+    walLog.clear();
+    obsolete.clear();
+    obsoleteSegments.clear();
     for (int level = 0; level <= totalLevel; ++level) { // 依层清空每一层的sstables
-        std::string path = std::string("./data/level-") + std::to_string(level);
-        int size         = utils::scanDir(path, files);
+        std::string path = levelPath(level);
+        if (!utils::dirExists(path)) // 由 MANIFEST 恢复时中间层的目录可能不存在
+            continue;
+        std::vector<std::string> files;
+        int size = utils::scanDir(path, files);
         for (int i = 0; i < size; ++i) {
             std::string file = path + "/" + files[i];
-            int ret = utils::rmfile(file.data());
+            utils::rmfile(file.data());
         }
         utils::rmdir(path.data());
-        sstableIndex[level].clear();
     }
+    installSnapshot([this](snapshot &next) {
+        next.mems = {s};
+        next.v    = std::make_shared<version>();
+    });
+    l0Files      = 0;
+    pendingBytes = 0;
+    manifestLog.open(manifestPath, {}); // 清空日志
+    valueLog.clear();
+    installedSegment = 0;
+    blockCache.clear(); // reset 后时间戳从 0 开始，文件名会被复用
+    tableCache.clear();
     TIME = 0;
     totalLevel = -1;
 }
@@ -274,92 +817,131 @@ void KVStore::reset() {
  * An empty string indicates not found.
  */
 
-struct myPair {
-    uint64_t key, time;
-    int id, index;
-    std::string filename;
-
-    myPair(uint64_t key, uint64_t time, int index, int id,
-           std::string file) { // construct function
-        this->time     = time;
-        this->key      = key;
-        this->id       = id;  //SSTable在层级中的位置
-        this->index    = index; // 在SSTable中的位置
-        this->filename = file;
-    }
-};
-
-struct cmp {
-    bool operator()(myPair &a, myPair &b) {
-        if (a.key == b.key)
-            return a.time < b.time;
-        return a.key > b.key;
-    }
-};
-
 /*key and data*/
 void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list) {
-    std::vector<std::pair<uint64_t, std::string>> mem;
-    // std::set<myPair> heap; // 维护一个指针最小堆
-    std::priority_queue<myPair, std::vector<myPair>, cmp> heap; //队列中存储的元素类型，优先队列使用的底层容器类型，比较器类型
-    // std::vector<sstable> ssts;
-    std::vector<sstablehead> sshs;
-    s->scan(key1, key2, mem);   // add in mem
-    std::vector<int> head, end; // [head, end)
-    int cnt = 0;
-    if (mem.size())
-        heap.push(myPair(mem[0].first, INF, 0, -1, "qwq")); //TA很可爱哈，INF: 表示无穷大的时间戳，确保内存中的数据优先级最高，0: 在内存中的索引位置 -1: 特殊标识，表示这是内存中的数据（不是 SSTable） "qwq": 一个占位符文件名，因为内存数据没有实际的文件名   
-    for (int level = 0; level <= totalLevel; ++level) {
-        for (sstablehead it : sstableIndex[level]) {
-            if (key1 > it.getMaxV() || key2 < it.getMinV())
+    auto it = newIterator(key1, key2);
+    for (; it->valid(); it->next())
+        list.emplace_back(it->key(), it->value());
+}
+
+// memtable、immutable memtable 和每张与 [lo, hi] 相交的表各作为一路，按新到旧的顺序交给 mergingIterator 归并。
+// memtable 中 [lo, hi] 内的数据复制一份；读表时按块预读，不经过 blockcache
+std::unique_ptr<dbIterator> KVStore::newIterator(uint64_t lo, uint64_t hi) {
+    std::vector<std::unique_ptr<kvIterator>> children;
+    std::vector<std::pair<int, rangedel>> dels; // 各路的范围删除，first 为所在的路
+    SnapshotRef cur = getSnapshot();
+    for (auto &m : cur->mems) {
+        std::vector<std::pair<uint64_t, std::string>> kvs;
+        m->scan(lo, hi, kvs);
+        if (!m->getRangeDels().empty())
+            dels.emplace_back(children.size(), m->getRangeDels());
+        children.push_back(std::make_unique<vectorIterator>(std::move(kvs)));
+    }
+    blockReader read = [this](const std::string &file, uint32_t offset, uint32_t len, std::string &buf) {
+        return readSequential(file, offset, len, buf);
+    };
+    const VersionRef &v = cur->v; // 迭代器持有它，表头在遍历期间有效
+    for (int level = 0; level < MAX_LEVELS; ++level) { // 按快照自己的层遍历，totalLevel 可能已经被 compaction 改过
+        int first = level ? v->lowerBound(level, lo) : 0; // level >= 1 有序，从第一个可能相交的表开始
+        for (int p = first; p < (int)v->levels[level].size(); ++p) {
+            const HeadRef &it = v->levels[level][p];
+            if (level && it->getMinV() > hi)
+                break;
+            if (lo > it->getMaxV() || hi < it->getMinV())
                 continue; // 无交集
-                
-            int hIndex = it.lowerBound(key1);
-            int tIndex = it.lowerBound(key2);
-            if (hIndex < it.getCnt()) { // 此sstable可用
-                // sstable ss; // 读sstable
-                std::string url = it.getFilename();
-                // ss.loadFile(url.data());
-
-                heap.push(myPair(it.getKey(hIndex), it.getTime(), hIndex, cnt++, url));
-                head.push_back(hIndex);
-                if (it.search(key2) == tIndex)
-                    tIndex++; // tIndex为第一个不可的
-                end.push_back(tIndex);
-                // ssts.push_back(ss); // 加入ss
-                sshs.push_back(it);
+            if (!it->ensureLoaded()) { // 读不出 index 的表跳过，不去按 header 中的 key 数读数据
+                metaErrors++;
+                continue;
             }
+            if (it->hasRangeDels())
+                dels.emplace_back(children.size(), it->getRangeDels());
+            children.push_back(std::make_unique<tableIterator>(it, read, lo));
         }
     }
-    uint64_t lastKey = INF; // only choose the latest key
-    while (!heap.empty()) { // 维护堆
-        myPair cur = heap.top();
-        heap.pop();
-        if (cur.id >= 0) { // from sst
-            if (cur.key != lastKey) {
-                lastKey         = cur.key;
-                uint32_t start  = sshs[cur.id].getOffset(cur.index - 1);
-                uint32_t len    = sshs[cur.id].getOffset(cur.index) - start;
-                uint32_t scnt   = sshs[cur.id].getCnt();
-                std::string res = fetchString(cur.filename, 10240 + 32 + scnt * 12 + start, len);
-                if (res.length() && res != DEL)
-                    list.emplace_back(cur.key, res);
-            }
-            if (cur.index + 1 < end[cur.id]) { // add next one to heap
-                heap.push(myPair(sshs[cur.id].getKey(cur.index + 1), cur.time, cur.index + 1, cur.id, cur.filename));
-            }
-        } else { // from mem
-            if (cur.key != lastKey) {
-                lastKey         = cur.key;
-                std::string res = mem[cur.index].second;
-                if (res.length() && res != DEL)
-                    list.emplace_back(cur.key, mem[cur.index].second);
+    valueReader readValue = [this](const std::string &ptr, std::string &val) { return this->readValue(ptr, val); };
+    return std::make_unique<dbIterator>(v, std::move(children), std::move(dels), lo, hi, readValue, cur->mems.size());
+}
+
+/**
+ * 从旧到新检查 value log 的每个段：一条记录仍然有效，当且仅当从 memtable 和各层表中查到的 key 的值就是指向它的指针。
+ * 失效数据的比例不低于 minGarbage 时，把有效的 value 重新写入 memtable（随 memtable 落盘写进新的段）。
+ * 写回时持有 writeLock，逐条重新确认 key 仍指向这个段，扫描之后被覆盖或删除的 key 不会被旧值盖回。
+ * WAL 刷盘之后换一个新的代次，段放进 obsoleteSegments，回收之前的 version 都释放之后才删除。
+ * 回收期间并发的写入可能触发落盘，段号大于 installedSegment 的段的表还没有装入 version，跳过。
+ */
+uint64_t KVStore::gcValueLog(double minGarbage) {
+    waitForBackground(); // 已经冻结的 memtable 先落盘，它们的段也参与这次回收
+    struct liveValue {
+        uint64_t key;
+        std::string ptr, val;
+    };
+    std::set<uint64_t> pending; // 已经回收、等旧 version 释放的段
+    {
+        std::lock_guard<std::mutex> edit(editLock);
+        purgeObsolete();
+        for (auto &it : obsoleteSegments)
+            pending.insert(it.second);
+    }
+    uint64_t freed = 0, installed = installedSegment; // 之后落盘的段可能还没有装入 version，看起来全是垃圾
+    for (uint64_t no : valueLog.segments()) {
+        if (no > installed)
+            break;
+        if (pending.count(no))
+            continue;
+        SnapshotRef view = getSnapshot();
+        uint64_t total = 0, used = 0;
+        std::vector<liveValue> live;
+        valueLog.scan(no, [&](uint64_t key, const std::string &ptr, const std::string &val) {
+            total += 16 + val.length();
+            if (pointsTo(*view, key, ptr)) {
+                used += 16 + val.length();
+                live.push_back({key, ptr, val});
             }
-            if (cur.index < mem.size() - 1) {
-                heap.push(myPair(mem[cur.index + 1].first, cur.time, cur.index + 1, -1, cur.filename));
+        });
+        if (total && total - used < minGarbage * total)
+            continue;
+        {
+            std::lock_guard<std::mutex> exclusive(writeLock);
+            for (auto &it : live) {
+                if (!pointsTo(*getSnapshot(), it.key, it.ptr))
+                    continue;
+                makeRoom(12 + it.val.length());
+                walLog.append(it.key, it.val); // 先写日志再写 memtable
+                s->upsert(it.key, it.val);
             }
         }
+        walLog.sync();
+        std::lock_guard<std::mutex> edit(editLock);
+        auto next   = std::make_shared<version>(*getVersion());
+        auto prev   = next->epoch;
+        next->epoch = std::make_shared<gcEpoch>();
+        prev->next  = next->epoch;
+        installSnapshot([&next](snapshot &cur) { cur.v = next; });
+        obsoleteSegments.emplace_back(std::move(prev), no);
+        purgeObsolete();
+        freed += total - used;
+    }
+    return freed;
+}
+
+// key 当前的值是否就是 ptr，即 memtable 中没有更新的写入，表中查到的就是这个指针
+bool KVStore::pointsTo(const snapshot &view, uint64_t key, const std::string &ptr) {
+    std::string cur;
+    return !searchMemtables(view.mems, key, cur) && searchTables(*view.v, key, cur) && cur == ptr;
+}
+
+// 扫描一遍所有表中的指针，统计仍被引用的记录
+vlogStats KVStore::getValueLogStats() {
+    vlogStats stats;
+    stats.segments   = valueLog.segments().size();
+    stats.totalBytes = valueLog.getBytes();
+    auto it          = newIterator();
+    for (; it->valid(); it->next()) {
+        valuePointer p;
+        if (vlog::decode(it->rawValue(), p))
+            stats.liveBytes += 16 + p.len;
     }
+    return stats;
 }
 
 bool isPathOfLevel(const std::string& path, int level) {
@@ -390,64 +972,14 @@ bool isPathOfLevel(const std::string& path, int level) {
 struct waitTablehead
 {
     uint64_t level;
-    sstablehead tablehead;
-    waitTablehead(sstablehead tablehead,uint64_t level)
+    HeadRef tablehead;
+    waitTablehead(HeadRef tablehead,uint64_t level)
     {
         this->level = level;
         this->tablehead = tablehead;
     }
 };
 
-std::vector<KVT>  KVStore::mergeSort(std::vector<KVT> left, std::vector<KVT> right )
-{
-    std::vector<KVT> result;
-    int leftIndex = 0, rightIndex = 0;
-
-    while (leftIndex < left.size() && rightIndex < right.size()) {
-        if (left[leftIndex].key < right[rightIndex].key) {
-            result.push_back(left[leftIndex]);
-            leftIndex++;
-        } else if(left[leftIndex].key > right[rightIndex].key) {
-            result.push_back(right[rightIndex]);
-            rightIndex++;
-        }
-        else
-        {
-            if(left[leftIndex].level<right[rightIndex].level)
-            {
-                result.push_back(left[leftIndex]);
-            }
-            else if(left[leftIndex].level>right[rightIndex].level)
-            {
-                result.push_back(right[rightIndex]);
-            }
-            else
-            {
-                if(left[leftIndex].time > right[rightIndex].time) //说明更新
-                    result.push_back(left[leftIndex]);
-                else    
-                    result.push_back(right[rightIndex]);
-            }
-            rightIndex++;
-            leftIndex++;
-        }
-    }
-
-    //把剩余的都塞进去
-    while (leftIndex < left.size()) {
-        result.push_back(left[leftIndex]);
-        leftIndex++;
-    }
-
-    while (rightIndex < right.size()) {
-        result.push_back(right[rightIndex]);
-        rightIndex++;
-    }
-
-    return result;
-
-}
-
 // std::vector<KVT> KVStore::parallelMergeSort(std::vector<KVT> left, std::vector<KVT> right) {
 //     const size_t total_size = left.size() + right.size();
 //     std::vector<KVT> result(total_size);
@@ -509,171 +1041,438 @@ std::vector<KVT>  KVStore::mergeSort(std::vector<KVT> left, std::vector<KVT> rig
 //     return result;
 // }
 
+// 每一层的得分为文件数 / 2^(level+1)，超过 1 说明需要往下一层合并
+double KVStore::levelScore(const version &v, int level) {
+    return v.levels[level].size() / pow(2, level + 1);
+}
+
+// 得分最高且超过 1 的层，没有返回 -1
+int KVStore::pickCompactionLevel() {
+    VersionRef v = getVersion();
+    int best     = -1;
+    double score = 1;
+    for (int level = 0; level + 1 < MAX_LEVELS; ++level) {
+        if (levelScore(*v, level) > score) {
+            score = levelScore(*v, level);
+            best  = level;
+        }
+    }
+    return best;
+}
+
+// 待合并的字节数估计：level 0 超过目标时整层都要合并，level n 为超出目标的那部分表
+uint64_t KVStore::estimatePendingBytes(const version &v) {
+    uint64_t pending = 0;
+    for (int level = 0; level + 1 < MAX_LEVELS; ++level) {
+        if (levelScore(v, level) <= 1)
+            continue;
+        std::vector<HeadRef> tables = v.levels[level];
+        size_t excess = level ? tables.size() - (size_t)pow(2, level + 1) : tables.size();
+        std::sort(tables.begin(), tables.end(), [](const HeadRef &a, const HeadRef &b) {
+            return a->getTime() < b->getTime(); // 与 compactLevel 一致，先合并旧的
+        });
+        for (size_t i = 0; i < excess; ++i)
+            pending += tables[i]->getBytes();
+    }
+    return pending;
+}
+
+// 让 compactor 合并到每一层都不超过目标，并等它做完
 void KVStore::compaction() {
-    int curLevel = 0;
+    std::unique_lock<std::mutex> guard(bgLock);
+    compactRequests++;
+    compactBusy = true;
+    compactCv.notify_one();
+    idleCv.wait(guard, [this] { return !compactBusy; });
+}
+
+void KVStore::compactionWork() {
+    std::unique_lock<std::mutex> guard(bgLock);
+    uint64_t seen = 0;
+    while (true) {
+        compactCv.wait(guard, [&] { return compactStop || compactRequests != seen; });
+        if (compactRequests == seen)
+            break; // 要退出且没有新的请求
+        seen = compactRequests;
+        guard.unlock();
+        for (int level; (level = pickCompactionLevel()) != -1;) {
+            bool done = compactLevel(level); // 一次只合并一层，每合并完一层都唤醒被 level 0 阻塞的写者
+            guard.lock();
+            if (!done) { // 输入读不出来或输出写不了，等下一次请求再试
+                guard.unlock();
+                break;
+            }
+            idleCv.notify_all();
+            guard.unlock();
+        }
+        guard.lock();
+        if (compactRequests == seen) { // 合并期间没有新的 level-0 表
+            compactBusy = false;
+            idleCv.notify_all();
+        }
+    }
+}
+
+// level 0 文件过多时限流：超过 L0_SLOWDOWN_TRIGGER 每次写入按超出的文件数延迟，达到 L0_STOP_TRIGGER 时等 compaction
+void KVStore::throttleWrite() {
+    int l0 = l0Files.load();
+    if (l0 < L0_SLOWDOWN_TRIGGER)
+        return;
+    auto start = std::chrono::steady_clock::now();
+    if (l0 >= L0_STOP_TRIGGER) {
+        std::unique_lock<std::mutex> guard(bgLock);
+        idleCv.wait(guard, [this] { return l0Files < L0_STOP_TRIGGER || !compactBusy; });
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(SLOWDOWN_DELAY * (l0 - L0_SLOWDOWN_TRIGGER + 1)));
+    }
+    stallMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 从输入表的块边界（旧格式为 Index 中的 key）中等距取 n - 1 个切分点，子任务 i 负责 (splits[i-1], splits[i]]
+static std::vector<uint64_t> chooseSplits(const std::vector<HeadRef> &inputs, size_t n) {
+    std::vector<uint64_t> bounds, splits;
+    if (n <= 1)
+        return splits;
+    for (auto &it : inputs) {
+        if (it->getFormat() == FORMAT_BLOCK) {
+            for (int b = 0; b < it->getBlockCnt(); ++b)
+                bounds.push_back(it->getBlock(b).lastKey);
+        } else {
+            for (uint64_t i = 0; i < it->getCnt(); ++i)
+                bounds.push_back(it->getKey(i));
+        }
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    for (size_t i = 1; i < n; ++i) {
+        uint64_t key = bounds[bounds.size() * i / n];
+        if (key != UINT64_MAX && (splits.empty() || splits.back() < key))
+            splits.push_back(key);
+    }
+    return splits;
+}
+
+// 更深的层中没有表可能包含 key 时，level 就是 key 所在的最底层。
+// key 范围包含 key 的表再用 bloom 排除，哈希只在第一次需要时算一次
+static bool isBottommost(const version &v, int level, uint64_t key) {
+    uint64_t hash[2];
+    bool hashed = false;
+    for (int deeper = level + 1; deeper < MAX_LEVELS; ++deeper) {
+        int p = v.find(deeper, key);
+        if (p == -1)
+            continue;
+        if (!hashed) {
+            bloom::hash(key, hash);
+            hashed = true;
+        }
+        if (v.levels[deeper][p]->mayContain(hash))
+            return false;
+    }
+    return true;
+}
+
+// 范围删除 [start, end] 与更深的层中的表都不相交时，它已经没有可以覆盖的数据
+static bool isBottommost(const version &v, int level, uint64_t start, uint64_t end) {
+    for (int deeper = level + 1; deeper < MAX_LEVELS; ++deeper) {
+        int p = v.lowerBound(deeper, start);
+        if (p < (int)v.levels[deeper].size() && v.levels[deeper][p]->getMinV() <= end)
+            return false;
+    }
+    return true;
+}
+
+// key 是否被比 source 新的来源（下标更小）的范围删除覆盖
+static bool coveredByNewer(const std::vector<std::pair<int, const rangedel *>> &dels, int source, uint64_t key) {
+    for (auto &it : dels) {
+        if (it.first < source && it.second->covers(key))
+            return true;
+    }
+    return false;
+}
+
+// 归并 inputs 中 [lo, hi] 内的 key，写成 level 层的新表；inputs 按优先级从高到低排列。
+// 同一个 key 的旧版本由 mergingIterator 丢弃，被较新输入的范围删除覆盖的 key 也不再写出；
+// 删除标记和范围删除在最底层时同样丢弃，其余的范围删除按 key 范围分给各个输出文件。
+// 新表写在 adds 中；输出文件打不开或写不进去时返回 false，已写出的表由调用者删除
+bool KVStore::subcompact(const version &v, const std::vector<HeadRef> &inputs, int level, uint64_t lo, uint64_t hi,
+                         std::vector<std::pair<int, HeadRef>> &adds) {
+    std::vector<std::unique_ptr<kvIterator>> children;
+    std::vector<std::pair<int, const rangedel *>> dels; // 各路的范围删除，first 为所在的路
+    rangedel tombs;
+    blockReader read = [this](const std::string &file, uint32_t offset, uint32_t len, std::string &buf) {
+        return readSequential(file, offset, len, buf);
+    };
+    for (auto &it : inputs) {
+        if (it->getMaxV() < lo || it->getMinV() > hi)
+            continue;
+        if (it->hasRangeDels()) {
+            dels.emplace_back(children.size(), &it->getRangeDels());
+            tombs.add(it->getRangeDels().clip(lo, hi));
+        }
+        children.push_back(std::make_unique<tableIterator>(it, read, lo));
+    }
+    std::vector<RangeTombstone> frags;
+    for (auto &it : tombs.getFrags()) {
+        if (isBottommost(v, level, it.start, it.end))
+            tombstonesDropped++;
+        else
+            frags.push_back(it);
+    }
+    mergingIterator merged(std::move(children));
+    std::string path = levelPath(level) + "/";
+    // 边归并边写出，满 MAXSIZE 换下一个文件
+    tablebuilder builder;
+    size_t f        = 0;
+    uint64_t fileLo = lo; // 当前文件负责 [fileLo, 下一个文件的第一个 key)
+    auto finish = [&](uint64_t fileHi) { // 写入 [fileLo, fileHi] 内的范围删除后结束当前文件
+        for (; f < frags.size() && frags[f].start <= fileHi; ++f) {
+            builder.addRangeDel(std::max(frags[f].start, fileLo), std::min(frags[f].end, fileHi));
+            if (frags[f].end > fileHi)
+                break; // 剩下的部分属于下一个文件
+        }
+        auto head = std::make_shared<sstablehead>();
+        if (!builder.finish(*head))
+            return false;
+        adds.emplace_back(level, head);
+        fileLo = fileHi + 1;
+        return true;
+    };
+    auto open = [&] {
+        uint64_t time = ++TIME;
+        return builder.open(path + std::to_string(time) + ".sst", time, policyFor(level));
+    };
+    for (; merged.valid() && merged.key() <= hi; merged.next()) {
+        const std::string &value = merged.value();
+        uint64_t key             = merged.key();
+        if (coveredByNewer(dels, merged.source(), key))
+            continue;
+        if (value == DEL && isBottommost(v, level, key)) {
+            tombstonesDropped++;
+            continue;
+        }
+        if (builder.isOpen() && builder.getBytes() + 12 + value.length() > MAXSIZE && !finish(key - 1))
+            return false;
+        if (!builder.isOpen() && !open())
+            return false;
+        builder.add(key, value);
+    }
+    if (!builder.isOpen() && f < frags.size() && !open())
+        return false; // 只剩范围删除，也要写出一个只有删除区间的表
+    return !builder.isOpen() || finish(hi);
+}
+
+bool KVStore::compactLevel(int curLevel) {
     uint64_t minVtmp = UINT64_MAX, maxVtmp = 0;
     std::vector<waitTablehead> waitlist;
-    std::priority_queue<poi, std::vector<poi>, cmpPoi> pq;
-    std::unordered_set<uint64_t> processedKeys;
-   //  std::unordered_map<uint64_t, uint64_t> keyMaxTime;
     int j = 0;
     int sizeCur, sizeNxt;
     bool updateLevel = false;
-    sstable newTable;
     std::string newPath;
-    
-    for(; curLevel <= totalLevel; curLevel++) {
-        updateLevel = false;
-        int num = 0;
-        std::vector<std::string> filesCur,filesNxt;
-        sizeCur = utils::scanDir("./data/level-" + std::to_string(curLevel),filesCur);
-        sizeNxt = (curLevel + 1 <= totalLevel) ? utils::scanDir("./data/level-" + std::to_string(curLevel+1), filesNxt) : 0;
-        if(sizeCur > pow(2, curLevel+1)) {
-            // Prepare for next level
-            if(sizeNxt == 0) {
-                updateLevel = true;
-                totalLevel++;
-            }            
-            waitlist.clear();
-
-            minVtmp = UINT64_MAX;
-            maxVtmp = 0;
-            if(curLevel == 0) {
-                //Level 0: take all SSTables
-                j = 0;
-                for(; j < sizeCur; j++) {
-                if(minVtmp > sstableIndex[curLevel][j].getMinV())
-                    minVtmp = sstableIndex[curLevel][j].getMinV();
-                if(maxVtmp < sstableIndex[curLevel][j].getMaxV())
-                    maxVtmp = sstableIndex[curLevel][j].getMaxV();
-                waitlist.push_back(waitTablehead(sstableIndex[curLevel][j],curLevel));
+    VersionRef v = getVersion(); // level >= 1 只有 compaction 线程修改，level 0 新增的表不在本次合并范围内
+    std::vector<std::pair<int, HeadRef>> adds;
+    std::vector<std::string> dels;
+    // 每一层的文件数直接取自 version，不再扫描目录；装入新表时 applyEdit 会更新 totalLevel
+    sizeCur = v->levels[curLevel].size();
+    sizeNxt = v->levels[curLevel + 1].size();
+    // Prepare for next level
+    if(sizeNxt == 0) {
+        updateLevel = true;
+    }            
+    waitlist.clear();
+
+    minVtmp = UINT64_MAX;
+    maxVtmp = 0;
+    if(curLevel == 0) {
+        //Level 0: take all SSTables
+        j = 0;
+        for(; j < sizeCur; j++) {
+        if(minVtmp > v->levels[curLevel][j]->getMinV())
+            minVtmp = v->levels[curLevel][j]->getMinV();
+        if(maxVtmp < v->levels[curLevel][j]->getMaxV())
+            maxVtmp = v->levels[curLevel][j]->getMaxV();
+        waitlist.push_back(waitTablehead(v->levels[curLevel][j],curLevel));
+    }
+    } else {
+        std::vector<waitTablehead> candidates;
+        for (int j = 0; j < sizeCur; j++) {
+            candidates.push_back({waitTablehead(
+                v->levels[curLevel][j],curLevel)
+            });
+        }
+        
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+            if (a.tablehead->getTime() != b.tablehead->getTime()) {
+                return a.tablehead->getTime() < b.tablehead->getTime();
             }
-            } else {
-                std::vector<waitTablehead> candidates;
-                for (int j = 0; j < sizeCur; j++) {
-                    candidates.push_back({waitTablehead(
-                        sstableIndex[curLevel][j],curLevel)
-                    });
-                }
-                
-                std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
-                    if (a.tablehead.getTime() != b.tablehead.getTime()) {
-                        return a.tablehead.getTime() < b.tablehead.getTime();
-                    }
-                    return a.tablehead.getMinV() < b.tablehead.getMinV();
-                });
-            //把time比较小（老东西），或者数值比较小的合并到后面去
-                int tablesToSelect = sizeCur - pow(2, curLevel+1);
-                for(j = 0; j < tablesToSelect && j < candidates.size(); j++)
+            return a.tablehead->getMinV() < b.tablehead->getMinV();
+        });
+    //把time比较小（老东西），或者数值比较小的合并到后面去
+        int tablesToSelect = sizeCur - pow(2, curLevel+1);
+        for(j = 0; j < tablesToSelect && j < candidates.size(); j++)
 {
-                    if(minVtmp > candidates[j].tablehead.getMinV())
-                        minVtmp = candidates[j].tablehead.getMinV();
-                    if(maxVtmp < candidates[j].tablehead.getMaxV())
-                        maxVtmp = candidates[j].tablehead.getMaxV();
-                    waitlist.push_back(candidates[j]);
-                }
-            }
-            
-            // Add overlapping SSTables from next level
-            if(!updateLevel && (curLevel + 1 <= totalLevel)) {
-                for(int j = 0; j < sizeNxt; j++) {
-                    if(!(sstableIndex[curLevel+1][j].getMaxV() < minVtmp || 
-                         sstableIndex[curLevel+1][j].getMinV() > maxVtmp)) {
-                        waitlist.push_back(waitTablehead(sstableIndex[curLevel+1][j],curLevel+1));
-                    }
-                }
-            }
-            
-            // Find the maximum timestamp for each key
-            int sizeWait = waitlist.size();
-            sstable sstables[sizeWait];
-            sstablehead sstableheads[sizeWait];
-            std::vector<KVT>  kvs;
-            std::vector<KVT>  mergedKVs;
-            for(int i = 0;i<sizeWait;i++) {
-                sstables[i].loadFile(waitlist[i].tablehead.getFilename().data());
-                sstableheads[i] = sstables[i].getHead();
-                kvs.clear();
-                for(int j = 0;j<sstableheads[i].getCnt();j++) {
-                    kvs.push_back(KVT(sstableheads[i].getKey(j), sstables[i].getData(j),sstableheads[i].getTime(),waitlist[i].level));
-                }
-                mergedKVs = mergeSort(mergedKVs,kvs);
-            }
-             //mergedKVs 现在是一个完全全新的要被加入到sstable的数据，然后顺序就是越早出队的越优先
-            
-             newPath = "./data/level-" + std::to_string(curLevel + 1) + "/"; //往
-             if (!utils::dirExists(newPath)) {
-                 utils::mkdir(newPath.data());
-             }
-             
-            for(int i = 0;i<mergedKVs.size();i++)
-            {
-                std::string value = mergedKVs[i].value;
-                uint64_t key =mergedKVs[i].key;
-                uint32_t nxtBytes = newTable.getHead().getBytes() + 12 + value.length() ;
-                if(nxtBytes <= MAXSIZE) {
-                    newTable.insert(key, value);
-                } else {
-                    // Flush current SSTable and create a new one
-                    std::string filename = newPath + std::to_string(++TIME) + ".sst";
-                    newTable.setFilename(filename);
-                    newTable.setTime(TIME);
-                    newTable.putFile(newTable.getFilename().data());
-                    addsstable(newTable, curLevel+1);
-                    newTable.reset();
-                    newTable.insert(key, value);
-                }
-            }
-            // Flush the final SSTable if it has entries
-            if(newTable.getCnt() > 0) {
-                std::string filename = newPath + std::to_string(++TIME) + ".sst";
-                newTable.setFilename(filename);
-                newTable.setTime(TIME);
-                newTable.putFile(newTable.getFilename().data());
-                addsstable(newTable, curLevel+1);
-                newTable.reset();
-            }
-            
-            // Delete processed SSTables
-            for(auto &it : waitlist) {
-                delsstable(it.tablehead.getFilename());
-            }
-            waitlist.clear();
+            if(minVtmp > candidates[j].tablehead->getMinV())
+                minVtmp = candidates[j].tablehead->getMinV();
+            if(maxVtmp < candidates[j].tablehead->getMaxV())
+                maxVtmp = candidates[j].tablehead->getMaxV();
+            waitlist.push_back(candidates[j]);
         }
     }
-}
-void KVStore::delsstable(std::string filename) {
-    for (int level = 0; level <= totalLevel; ++level) {
-        int size = sstableIndex[level].size(), flag = 0;
-        for (int i = 0; i < size; ++i) {
-            if (sstableIndex[level][i].getFilename() == filename) {
-                sstableIndex[level].erase(sstableIndex[level].begin() + i);
-                flag = 1;
-                break;
+    
+    // Add overlapping SSTables from next level
+    if(!updateLevel && (curLevel + 1 <= totalLevel)) {
+        for(int j = 0; j < sizeNxt; j++) {
+            if(!(v->levels[curLevel+1][j]->getMaxV() < minVtmp || 
+                 v->levels[curLevel+1][j]->getMinV() > maxVtmp)) {
+                waitlist.push_back(waitTablehead(v->levels[curLevel+1][j],curLevel+1));
             }
         }
-        if (flag)
-            break;
     }
-    int flag = utils::rmfile(filename.data());
-    if (flag != 0) {
-        std::cout << "delete fail!" << std::endl;
-        std::cout << "filename" <<filename<<std::endl;
-        std::cout << strerror(errno) << std::endl;
+    
+    // 输入按优先级排序：层数小的新，同一层时间戳大的新；归并时同一个 key 只保留最新的
+    std::sort(waitlist.begin(), waitlist.end(), [](const waitTablehead &a, const waitTablehead &b) {
+        if (a.level != b.level)
+            return a.level < b.level;
+        return a.tablehead->getTime() > b.tablehead->getTime();
+    });
+    std::vector<HeadRef> inputs;
+    uint64_t inputBytes = 0;
+    for (auto &it : waitlist) {
+        if (!it.tablehead->ensureLoaded()) {
+            metaErrors++;
+            return false; // 读不出 index 的表无法归并，保留全部输入
+        }
+        inputs.push_back(it.tablehead);
+        inputBytes += it.tablehead->getBytes();
+    }
+
+    newPath = levelPath(curLevel + 1) + "/"; //往
+    bool created = !utils::dirExists(newPath);
+    if (created && utils::mkdir(newPath.data()) != 0) {
+        std::perror(newPath.data());
+        return false;
+    }
+    // 按 key 范围切成互不相交的子任务并行归并，每个子任务至少有一个满表的数据量
+    size_t subs = std::min<uint64_t>(maxSubcompactions, std::max<uint64_t>(1, inputBytes / MAXSIZE));
+    std::vector<uint64_t> splits = chooseSplits(inputs, subs);
+    bool ok = true;
+    if (splits.empty()) {
+        ok = subcompact(*v, inputs, curLevel + 1, 0, UINT64_MAX, adds);
+    } else {
+        ThreadPool pool(splits.size() + 1);
+        std::vector<std::vector<std::pair<int, HeadRef>>> outputs(splits.size() + 1);
+        std::vector<std::future<bool>> results;
+        uint64_t lo = 0;
+        for (size_t i = 0; i <= splits.size(); ++i) {
+            uint64_t hi = i < splits.size() ? splits[i] : UINT64_MAX;
+            auto &out   = outputs[i];
+            results.push_back(pool.submit([this, &v, &inputs, &out, curLevel, lo, hi] {
+                return subcompact(*v, inputs, curLevel + 1, lo, hi, out);
+            }));
+            lo = hi + 1;
+        }
+        for (size_t i = 0; i < results.size(); ++i) { // 所有子任务的输出和删除一起装入新 version
+            ok &= results[i].get();
+            adds.insert(adds.end(), outputs[i].begin(), outputs[i].end());
+        }
+    }
+    // 输出和它们的目录项落盘之后才记入 MANIFEST、删除输入
+    ok = ok && utils::syncDir(newPath.data()) == 0 && (!created || utils::syncDir(dataDir.data()) == 0);
+    if (!ok) { // 输出没写全，放弃这次合并：新表还没记入 MANIFEST，直接删除，输入原样保留
+        for (auto &it : adds)
+            utils::rmfile(it.second->getFilename().data());
+        return false;
     }
+
+    // Delete processed SSTables: 新表和删除一起装入新 version
+    for(auto &it : waitlist) {
+        dels.push_back(it.tablehead->getFilename());
+    }
+    applyEdit(adds, dels);
+    return true;
+}
+void KVStore::delsstable(std::string filename) {
+    applyEdit({}, {filename});
 }
 
 void KVStore::addsstable(sstable ss, int level) {
-    sstableIndex[level].push_back(ss.getHead());
+    applyEdit({{level, std::make_shared<sstablehead>(ss.getHead())}}, {});
+}
+
+VersionRef KVStore::getVersion() const {
+    return getSnapshot()->v;
+}
+
+void KVStore::applyEdit(const std::vector<std::pair<int, HeadRef>> &adds, const std::vector<std::string> &dels) {
+    std::lock_guard<std::mutex> guard(editLock); // 落盘线程和 compaction 线程都会装入新 version
+    auto next = std::make_shared<version>(*getVersion(), adds, dels);
+    std::vector<std::pair<int, std::string>> names;
+    for (auto &it : adds) {
+        names.emplace_back(it.first, it.second->getFilename());
+        totalLevel = std::max(totalLevel.load(), it.first);
+    }
+    manifestLog.logEdit(names, dels); // 先落盘日志，再装入 version、删除旧文件
+    if (manifestLog.getRecords() > MANIFEST_REWRITE) {
+        std::vector<std::vector<std::string>> live(MAX_LEVELS);
+        for (int level = 0; level < MAX_LEVELS; ++level) {
+            for (auto &it : next->levels[level])
+                live[level].push_back(it->getFilename());
+        }
+        manifestLog.open(manifestPath, live);
+    }
+    VersionRef prev = getVersion();
+    installSnapshot([&next](snapshot &cur) { cur.v = next; });
+    l0Files      = next->levels[0].size();
+    pendingBytes = estimatePendingBytes(*next);
+    // 读者可能还持有旧 version，被删除的表先放进 obsolete，没有读者后再删文件
+    for (int level = 0; level < MAX_LEVELS; ++level) {
+        for (auto &it : prev->levels[level]) {
+            if (std::find(dels.begin(), dels.end(), it->getFilename()) != dels.end())
+                obsolete.push_back(it);
+        }
+    }
+    prev.reset();
+    purgeObsolete();
 }
 
-char strBuf[2097152];
+// 持有 editLock，或者后台线程空闲时调用
+void KVStore::purgeObsolete() {
+    for (auto it = obsolete.begin(); it != obsolete.end();) {
+        if (it->use_count() > 1) { // 还有 version 引用它
+            ++it;
+            continue;
+        }
+        std::string filename = (*it)->getFilename();
+        blockCache.erase(filename);
+        tableCache.erase(filename); // 关闭缓存的文件描述符
+        int flag = utils::rmfile(filename.data());
+        if (flag != 0) {
+            std::cout << "delete fail!" << std::endl;
+            std::cout << "filename" <<filename<<std::endl;
+            std::cout << strerror(errno) << std::endl;
+        }
+        it = obsolete.erase(it);
+    }
+    // 按回收顺序检查：更早的代次还在时，它经 next 引用着之后的代次
+    for (auto it = obsoleteSegments.begin(); it != obsoleteSegments.end();) {
+        if (it->first.use_count() > 1) { // 还有回收之前的 version
+            ++it;
+            continue;
+        }
+        std::string path = valueLog.path(it->second);
+        blockCache.erase(path);
+        tableCache.erase(path);
+        valueLog.remove(it->second);
+        it = obsoleteSegments.erase(it);
+    }
+}
 
 /**
  * @brief Fetches a substring from a file starting at a given offset.
  *
- * This function opens a file in binary read mode, seeks to the specified start offset,
- * reads a specified number of bytes into a buffer, and returns the buffer as a string.
+ * The file descriptor comes from tableCache, so repeated reads of the same
+ * sstable do not reopen it, and the bytes are read with a single pread.
+ * Results are kept in blockCache keyed by (file, startOffset); sstable files are
+ * immutable, so entries only go stale when delsstable or reset removes the file.
  *
  * @param file The path to the file from which to read the substring.
  * @param startOffset The offset in the file from which to start reading. 
@@ -681,28 +1480,21 @@ char strBuf[2097152];
  * @return A string containing the read bytes.
  */
 std::string KVStore::fetchString(std::string file, int startOffset, uint32_t len) {
-    // TODO here
-    memset(strBuf, 0, sizeof(strBuf));
-    FILE *fp = fopen(file.c_str(), "rb");
-    if (fp == NULL) {
+    std::string res;
+    if (blockCache.lookup(file, startOffset, res))
+        return res;
+    long bytesRead = tableCache.read(file, startOffset, len, res);
+    if (bytesRead < 0) {
         std::cerr << "Failed to open file: " << file << std::endl;
         return "";
-    }   
-    fseek(fp, startOffset, SEEK_SET);
-    size_t bytesRead = fread(strBuf, 1, len, fp);
-    strBuf[len] = '\0';
+    }
     if (bytesRead != len) {
         // 处理错误：未能读取所有请求的字节
-        if (feof(fp)) {
-            // 文件尾
-            std::cerr << "Reached end of file unexpectedly" << std::endl;
-        } else if (ferror(fp)) {
-            // 读取错误
-            std::cerr << "Error reading file: " << strerror(errno) << std::endl;
-        }
+        std::cerr << "Reached end of file unexpectedly" << std::endl;
+        return res;
     }
-    fclose(fp);
-    return std::string(strBuf, len);
+    blockCache.insert(file, startOffset, res);
+    return res;
 }
 float  KVStore::cosine_similarity(std::vector<float> a,std::vector<float> b)
 {
@@ -735,6 +1527,7 @@ std::vector<std::pair<std::uint64_t, std::string>> KVStore::query_knn(std::vecto
     using SimilarityPair = std::pair<float, std::pair<uint64_t, std::string>>;
     std::priority_queue<SimilarityPair, std::vector<SimilarityPair>, decltype(cmp)> top_k(cmp);
 
+    std::shared_lock<std::shared_mutex> guard(cacheLock); // 多个检索可以同时进行
     for (const auto& [key, embedding] : Cache) {
         
         float sim = cosine_similarity(embedding, embStr);
@@ -1034,6 +1827,8 @@ void KVStore::save_embedding_to_disk(const std::string &data_root)
         }
         for(auto it:dirty_keys) //被修改过的数据
         {
+            if(Cache.count(it) && Cache[it].size() != dim)
+                continue; // 没有 embedding 的 value 不写入
             fwrite(&it,sizeof(std::uint64_t),1,file);
             if(Cache.count(it)) //如果现在还在cache当中，说明是被修改
             {
@@ -1061,6 +1856,8 @@ void KVStore::save_embedding_to_disk(const std::string &data_root)
         fwrite(&dim,sizeof(std::uint64_t),1,file);
         for(auto it:Cache)
         {
+            if(it.second.size() != dim)
+                continue; // 没有 embedding 的 value 不写入
             fwrite(&it.first,sizeof(std::uint64_t),1,file);
             fwrite(it.second.data(),sizeof(float),dim,file);
         }
@@ -1114,6 +1911,7 @@ std::vector<std::pair<std::uint64_t, std::string>> KVStore::query_knn_parallel(
     const std::vector<float>& embStr,
     int k)
 {
+    std::shared_lock<std::shared_mutex> guard(cacheLock); // 各块并行遍历 Cache 期间持有读锁
     if (Cache.empty() || k <= 0) {
         return {}; // 无数据或 k 无效
     }
@@ -1181,31 +1979,17 @@ std::vector<std::pair<std::uint64_t, std::string>> KVStore::query_knn_parallel(
         top_k_global.pop();
     }
     std::reverse(final_sim_keys.begin(), final_sim_keys.end()); // 变为降序排列
-    std::vector<std::future<std::string>> get_futures;
+    guard.unlock();
     std::vector<std::uint64_t> keys;
-    get_futures.reserve(final_sim_keys.size());
     keys.reserve(final_sim_keys.size());
+    for(const auto& sim_key : final_sim_keys)
+        keys.push_back(sim_key.second);
 
-    for(const auto& sim_key : final_sim_keys){
-        std::uint64_t key = sim_key.second;
-        keys.push_back(key);
-        get_futures.push_back(
-            std::async(std::launch::async,
-                       &KVStore::get, // 成员函数指针
-                       this, // 调用成员函数需要传递对象指针
-                       key)
-        );
-    }
-
+    // 在同一个快照中批量读出 value，不再为每个 key 单独起线程
+    std::vector<std::string> values = multiGet(keys);
     std::vector<std::pair<std::uint64_t, std::string>> result;
-    result.reserve(get_futures.size());
-
-    for (size_t i = 0; i < get_futures.size(); ++i) {
-        try {
-            result.emplace_back(keys[i], get_futures[i].get());
-        } catch (const std::exception& e) {
-            std::cerr << "Error in Get task: " << e.what() << std::endl;
-        }
-    }
+    result.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+        result.emplace_back(keys[i], std::move(values[i]));
     return result;
 }
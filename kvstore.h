@@ -1,9 +1,16 @@
 #pragma once
 
 #include "kvstore_api.h"
-#include "skiplist.h"
+#include "memtable.h"
 #include "sstable.h"
 #include "sstablehead.h"
+#include "blockcache.h"
+#include "tablecache.h"
+#include "version.h"
+#include "iterator.h"
+#include "manifest.h"
+#include "wal.h"
+#include "threadpool.h"
 #include "embedding.h"
 #include "hnsw.h"
 #include "embedding.h"
@@ -13,6 +20,12 @@
 #include <unordered_set>
 #include <utility> 
 #include <future>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 
 #include <vector>
 #include <string>
@@ -26,28 +39,86 @@
 #include <iostream> // For demonstration output
 #include <map> 
 
-struct KVT
-{
-    uint64_t key;
-    std::string value;
-    uint64_t time;
-    uint64_t level;
-    KVT(uint64_t key, std::string value, uint64_t time,uint64_t level)
-    {
-        this->key = key;
-        this->value = value;
-        this->time = time;
-        this->level = level;
-    }
+const size_t DEFAULT_MAX_IMMUTABLES = 2; // 等待落盘的 memtable 达到这个数时，put 阻塞直到后台落盘完一个
+const size_t MULTIGET_READERS       = 4; // multiGet 并发读不同文件的线程数
+
+// getPinned 的结果：data 指向 mmap 映射区或 lease 持有的缓冲区，lease 存在期间有效；不存在时 data 为空
+struct pinnedValue {
+    std::string_view data;
+    readLease lease;
 };
 
 class KVStore : public KVStoreAPI {
     // You can add your implementation here
 private:
-    skiplist *s = new skiplist(0.5); // memtable
+    std::shared_ptr<memtable> s = newMemtable(MEMTABLE_SKIPLIST); // memtable，只有写队列的 leader 写入，持有 writeLock 时替换
+    memtableKind memKind = MEMTABLE_SKIPLIST; // 新建 memtable 时使用的实现
+    // 读者的一致视图：memtable、immutable memtable 和 version 一起整体替换，读者取到之后不再加锁
+    struct snapshot {
+        std::vector<std::shared_ptr<memtable>> mems; // 新的在前，mems[0] 是可写的 memtable
+        VersionRef v = std::make_shared<version>();  // 每一层的 sstable 表头
+    };
+    using SnapshotRef = std::shared_ptr<const snapshot>;
+    SnapshotRef snap = std::make_shared<snapshot>();
+    std::mutex snapLock; // 串行化 installSnapshot 的复制-修改-替换，持有时不再加别的锁
+    // 写队列中的一次写：put / del 写 key 的 val，deleteRange 写 [key, end]
+    struct writeOp {
+        uint64_t key;
+        std::string_view val;
+        uint64_t end = 0;
+        bool range   = false;
+        bool done    = false;
+        std::condition_variable cv;
+    };
+    std::mutex queueLock;          // 保护 writers
+    std::deque<writeOp *> writers; // 队首是 leader
+    std::mutex writeLock;          // leader 写 WAL 和 memtable 时持有，替换 s 的操作也持有
+    struct Immutable {
+        std::shared_ptr<memtable> table; // 写满后不再修改的 memtable
+        std::string log;                 // 它的 WAL 文件，落盘后删除
+    };
+    std::deque<Immutable> imms; // 等待后台线程落盘，旧的在前
+    size_t maxImmutables = DEFAULT_MAX_IMMUTABLES;
+    std::mutex bgLock;               // 保护 imms 和后台线程状态
+    std::condition_variable bgCv;    // 有新的 immutable memtable 或者要退出时唤醒后台线程
+    std::condition_variable idleCv;  // 后台落盘完一个 memtable / 做完一轮 compaction 时唤醒等待者
+    bool bgStop = false;
+    bool bgBusy = false;
+    std::thread flusher;             // 后台落盘
+    std::condition_variable compactCv; // 有新的 level-0 表或者要退出时唤醒 compactor
+    uint64_t compactRequests = 0;
+    bool compactStop = false;
+    bool compactBusy = false;        // 还有没处理完的 compaction 请求
+    std::thread compactor;           // 按得分挑选需要合并的层
+    std::mutex editLock;             // 保护 applyEdit 中的 version 替换、MANIFEST、obsolete 和 obsoleteSegments
+    std::atomic<int> l0Files{0};
+    std::atomic<uint64_t> pendingBytes{0};
+    std::atomic<uint64_t> stallMicros{0};
+    std::atomic<uint64_t> tombstonesDropped{0};
+    std::atomic<uint64_t> metaErrors{0};
+    filterPolicy policies[MAX_LEVELS];  // 每层新写出的表的过滤器
+    mutable std::mutex policyLock;      // 保护 policies，持有时不再加别的锁
+    std::atomic<uint32_t> filterBudget{0}; // 平均每个 key 的过滤器位数，非 0 时按层重新分配 bitsPerKey
+    vlog valueLog;                         // 键值分离时存放大 value
+    std::atomic<uint64_t> installedSegment{0}; // 引用它的表已经装入 version 的最大段号，更新的段还在落盘，GC 不碰
+    std::atomic<uint32_t> vlogThreshold{0}; // 落盘时长度不小于它的 value 写入 value log，0 表示不分离
+    std::atomic<size_t> maxSubcompactions{std::max(1u, std::thread::hardware_concurrency())}; // 一次 compaction 最多拆成的子任务数
+    std::vector<HeadRef> obsolete;   // 已从 version 中去掉、可能还有读者持有的表，没有读者后才物理删除
+    std::vector<std::pair<std::shared_ptr<gcEpoch>, uint64_t>> obsoleteSegments; // 已回收的 value log 段和回收前的代次
     // std::vector<sstablehead> sstableIndex;  // sstable的表头缓存
-    std::vector<sstablehead> sstableIndex[15]; // the sshead for each level 这个是一个二维的。
+    std::atomic<uint64_t> TIME{0}; // 表的时间戳，落盘线程和 compaction 线程都会递增
+    manifest manifestLog;     // version edit 日志，启动时据此恢复每一层的文件
+    std::string manifestPath;
+    std::string dataDir;      // 构造时传入的目录，各层的表、MANIFEST、WAL 和 value log 都在它下面
+    wal walLog;               // put / del 先写日志再写 memtable，每个 memtable 一个日志文件
+    std::string walDir;
+    std::string walPath;
+    uint64_t logNo = 0;
     std::unordered_map<std::uint64_t, std::vector<float>> Cache;
+    std::shared_mutex cacheLock; // 保护 Cache、dirty_keys、deleted_nodes 和向量索引中的删除标记，向量检索持读锁
+    blockcache blockCache; // fetchString 读出的块/值的缓存
+    tablecache tableCache; // 已打开的 sstable 文件
+    ThreadPool readers{MULTIGET_READERS}; // multiGet 中并发读文件
     std::unordered_set<uint64_t> dirty_keys;  // 需要删除的key
     struct DeletedNode
     {
@@ -56,7 +127,7 @@ private:
         DeletedNode(uint64_t k, std::vector<float> v) : id(k), vector(v) {};
     };
     std::vector<DeletedNode> deleted_nodes; //存储key
-    int totalLevel = -1; // 层数
+    std::atomic<int> totalLevel{-1}; // 层数，后台 compaction 会修改
     uint64_t dim = 768;
     using SimKey = std::pair<float, std::uint64_t>;
     std::vector<SimKey> find_top_k_in_chunk(
@@ -64,9 +135,40 @@ private:
        std::unordered_map<std::uint64_t, std::vector<float>>::const_iterator end,
         const std::vector<float>& query_embedding,
         int k_per_chunk);
+
+    void freezeMemtable();                      // 当前 memtable 转入 imms，换一个新的 memtable 和日志；持有 writeLock
+    bool flushImmutable(const Immutable &imm); // 写成 level-0 的 sstable，失败时保留 WAL
+    void backgroundWork();
+    void waitForBackground();                   // 等 imms 全部落盘、compaction 做完
+    SnapshotRef getSnapshot() const;
+    void installSnapshot(const std::function<void(snapshot &)> &edit); // 复制当前快照，edit 修改后整体替换
+    void makeRoom(size_t need); // 当前 memtable 放不下 need 字节时换一个；持有 writeLock
+    void write(writeOp &w);     // 排队写入，返回时已经写入 WAL 和 memtable
+    void purgeObsolete();
+    void compactionWork();
+    bool compactLevel(int level);     // 把 level 中超出目标的表合并到下一层，输入读不出来或输出没能落盘时返回 false
+    bool subcompact(const version &v, const std::vector<HeadRef> &inputs, int level, uint64_t lo, uint64_t hi,
+                    std::vector<std::pair<int, HeadRef>> &adds);
+    int pickCompactionLevel();
+    static double levelScore(const version &v, int level);
+    static uint64_t estimatePendingBytes(const version &v);
+    void throttleWrite();
+    bool searchTable(const HeadRef &it, uint64_t key, const uint64_t *hash, std::string &val); // hash 为 bloom::hash 的结果
+    bool searchMemtables(const std::vector<std::shared_ptr<memtable>> &mems, uint64_t key, std::string &val);
+    bool searchTables(const version &v, uint64_t key, std::string &val); // val 可能是 value log 指针
+    bool pointsTo(const snapshot &view, uint64_t key, const std::string &ptr); // key 当前的值是否就是 ptr
+    bool readValue(const std::string &ptr, std::string &val);           // 按指针从 value log 读出 value
+    bool readSequential(const std::string &file, uint32_t offset, uint32_t len, std::string &buf);
+    bool pinTable(const HeadRef &it, uint64_t key, const uint64_t *hash, pinnedValue &val);
+    bool pinRange(const std::string &file, uint32_t offset, uint32_t len, pinnedValue &val);
+    std::string separateValue(vlog::writer &values, uint64_t key, const std::string &val);
+    std::string levelPath(int level) const { // level 层的表所在的目录，不带末尾的 /
+        return dataDir + "/level-" + std::to_string(level);
+    }
+    void writeValue(uint64_t key, std::string_view val); // 经写队列写 WAL 和 memtable
     
 public:
-    KVStore(const std::string &dir);
+    KVStore(const std::string &dir, size_t cacheCapacity = DEFAULT_CACHE_CAPACITY, bool lazyLoad = true);
     HNSW hnsw_index; // M, M_max, efConstruction, m_L, dim
 
     ~KVStore();
@@ -75,23 +177,128 @@ public:
 
     std::string get(uint64_t key) override;
 
+    pinnedValue getPinned(uint64_t key); // 不复制 value 的 get
+
+    std::vector<std::string> multiGet(const std::vector<uint64_t> &keys); // 结果与 keys 一一对应，空串表示不存在
+
     bool del(uint64_t key) override;
 
+    void deleteRange(uint64_t key1, uint64_t key2) override;
+
     void reset() override;
  
     void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list) override;
 
+    // 只包含 [lo, hi] 内的 key 的迭代器，位于第一个 key；memtable 中的这段数据在创建时复制，之后的写入不可见
+    std::unique_ptr<dbIterator> newIterator(uint64_t lo = 0, uint64_t hi = UINT64_MAX);
+
     void compaction();
 
     void delsstable(std::string filename);  // 从缓存中删除filename.sst， 并物理删除
     void addsstable(sstable ss, int level); // 将ss加入缓存
+    VersionRef getVersion() const;          // 取当前快照中的 version，读者持有期间不受 compaction 影响
+    void applyEdit(const std::vector<std::pair<int, HeadRef>> &adds,
+                   const std::vector<std::string> &dels); // 一次性装入新 version，并物理删除 dels
     std::vector<std::pair<std::uint64_t, std::string>> search_knn(std::string query, int k);
     std::vector<std::pair<std::uint64_t, std::string>> search_knn_parallel(std::string query, int k);
     float cosine_similarity(std::vector<float> a,std::vector<float> b);
     float dot_product(std::vector<float>a,std::vector<float>b);
     float vector_norm(std::vector<float>a);
-    std::vector<KVT> mergeSort(std::vector<KVT> left, std::vector<KVT> right );
     std::string fetchString(std::string file, int startOffset, uint32_t len);
+
+    void setCacheCapacity(size_t capacity) {
+        blockCache.setCapacity(capacity);
+    }
+
+    uint64_t getCacheHits() const {
+        return blockCache.getHits();
+    }
+
+    uint64_t getCacheMisses() const {
+        return blockCache.getMisses();
+    }
+
+    void setTableCacheCapacity(size_t capacity) {
+        tableCache.setCapacity(capacity);
+    }
+
+    void setWalSyncMode(walSync mode) { // 之后换 memtable 打开的新日志沿用这个方式
+        walLog.setSyncMode(mode);
+    }
+
+    walSync getWalSyncMode() {
+        return walLog.getSyncMode();
+    }
+
+    uint64_t getPendingCompactionBytes() const {
+        return pendingBytes;
+    }
+
+    uint64_t getWriteStallMicros() const { // 写入因 level 0 过多被延迟、阻塞的总时间
+        return stallMicros;
+    }
+
+    uint64_t getTombstonesDropped() const { // compaction 在最底层丢弃的删除标记数
+        return tombstonesDropped;
+    }
+
+    // 读不出 bloom / index 的表被跳过的次数：get、multiGet、getPinned 这时按找不到返回，迭代器不含这张表的数据
+    uint64_t getMetaErrors() const {
+        return metaErrors;
+    }
+
+    void setMmapReads(bool on) { // sstable 和 value log 改为 mmap 读，只影响之后打开的文件
+        tableCache.setMmap(on);
+    }
+
+    void setValueSeparation(uint32_t threshold) { // 0 关闭；只影响之后落盘的 memtable
+        vlogThreshold = threshold;
+    }
+
+    // 选择 memtable 的实现：当前 memtable 为空时立即替换，否则从下一次换 memtable 开始生效
+    void setMemtableKind(memtableKind kind) {
+        std::lock_guard<std::mutex> guard(writeLock);
+        memKind = kind;
+        if (s->getBytes() || !s->getRangeDels().empty())
+            return;
+        s = newMemtable(kind);
+        installSnapshot([this](snapshot &next) { next.mems[0] = s; });
+    }
+
+    // 回收失效数据比例不低于 minGarbage 的 value log 段，返回释放的字节数
+    uint64_t gcValueLog(double minGarbage = DEFAULT_VLOG_GC_THRESHOLD);
+    vlogStats getValueLogStats();
+
+    void setBloomBitsPerKey(uint32_t bits) { // 所有层都用分块 bloom，只影响之后写出的表
+        std::lock_guard<std::mutex> guard(policyLock);
+        filterBudget = 0;
+        for (auto &it : policies)
+            it = filterPolicy(FILTER_BLOOM, bits ? bits : 1);
+    }
+
+    void setFilterPolicy(int level, filterPolicy policy) { // 单独指定一层
+        if (level < 0 || level >= MAX_LEVELS)
+            return;
+        std::lock_guard<std::mutex> guard(policyLock);
+        policies[level] = policy;
+    }
+
+    void setFilterMemoryBudget(uint32_t avgBitsPerKey) { // 0 关闭，回到每层各自的 bitsPerKey
+        filterBudget = avgBitsPerKey;
+    }
+
+    filterPolicy policyFor(int level) const;
+
+    void setMaxSubcompactions(size_t cnt) {
+        maxSubcompactions = cnt ? cnt : 1;
+    }
+
+    void setMaxImmutables(size_t cnt) {
+        std::lock_guard<std::mutex> guard(bgLock);
+        maxImmutables = cnt ? cnt : 1;
+        idleCv.notify_all();
+    }
+
     std::vector<std::pair<std::uint64_t, std::string>>search_knn_hnsw(std::string query, int k);
     std::vector<std::pair<std::uint64_t, std::string>> query_knn(std::vector<float> embStr,int k);
     std::vector<std::pair<std::uint64_t, std::string>> query_knn_parallel(const std::vector<float>& embStr, int k);
@@ -34,6 +34,12 @@ public:
      */
     virtual bool del(uint64_t key) = 0;
 
+    /**
+     * Delete all key-value pairs whose key lies in [key1, key2].
+     * Writes a single range tombstone instead of one marker per key.
+     */
+    virtual void deleteRange(uint64_t key1, uint64_t key2) = 0;
+
     /**
      * This resets the kvstore. All key-value pairs should be removed,
      * including memtable and all sstables files.
@@ -0,0 +1,135 @@
+#include "manifest.h"
+
+#include "utils.h"
+
+#include <cstring>
+#include <unistd.h>
+
+static void putU32(std::string &buf, uint32_t v) {
+    buf.append(reinterpret_cast<const char *>(&v), 4);
+}
+
+static void putName(std::string &buf, const std::string &name) {
+    putU32(buf, name.length());
+    buf.append(name);
+}
+
+// 从 buf 的 pos 处读一个 u32，越界返回 false
+static bool getU32(const std::string &buf, size_t &pos, uint32_t &v) {
+    if (pos + 4 > buf.size())
+        return false;
+    std::memcpy(&v, buf.data() + pos, 4);
+    pos += 4;
+    return true;
+}
+
+static bool getName(const std::string &buf, size_t &pos, std::string &name) {
+    uint32_t len;
+    if (!getU32(buf, pos, len) || pos + len > buf.size())
+        return false;
+    name.assign(buf.data() + pos, len);
+    pos += len;
+    return true;
+}
+
+bool manifest::recover(const std::string &path, std::vector<std::vector<std::string>> &levels) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL)
+        return false;
+    while (true) {
+        uint32_t len, sum;
+        if (fread(&len, 4, 1, fp) != 1)
+            break;
+        std::string payload(len, '\0');
+        if (fread(&payload[0], 1, len, fp) != len || fread(&sum, 4, 1, fp) != 1)
+            break; // 写了一半的记录
+        if (utils::checksum(payload.data(), len) != sum)
+            break;
+        size_t pos = 0;
+        uint32_t nAdds = 0, nDels = 0, level = 0; // 读越界时 getU32 不写入
+        std::string name;
+        getU32(payload, pos, nAdds);
+        for (uint32_t i = 0; i < nAdds; ++i) {
+            getU32(payload, pos, level);
+            getName(payload, pos, name);
+            if (levels.size() <= level)
+                levels.resize(level + 1);
+            levels[level].push_back(name);
+        }
+        getU32(payload, pos, nDels);
+        for (uint32_t i = 0; i < nDels; ++i) {
+            getName(payload, pos, name);
+            for (auto &files : levels) {
+                for (auto it = files.begin(); it != files.end(); ++it) {
+                    if (*it == name) {
+                        files.erase(it);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+void manifest::append(const std::string &payload) {
+    uint32_t len = payload.length(), sum = utils::checksum(payload.data(), len);
+    std::string buf;
+    putU32(buf, len);
+    buf.append(payload);
+    putU32(buf, sum);
+    fwrite(buf.data(), 1, buf.size(), file);
+    fflush(file);
+    fsync(fileno(file)); // 记录落盘之后调用者才会删除旧文件
+    records++;
+}
+
+void manifest::open(const std::string &path, const std::vector<std::vector<std::string>> &levels) {
+    close();
+    this->path      = path;
+    std::string tmp = path + ".tmp";
+    file            = fopen(tmp.c_str(), "wb");
+    if (file == NULL) {
+        std::perror(tmp.c_str());
+        return;
+    }
+    std::string payload;
+    uint32_t nAdds = 0;
+    for (auto &files : levels)
+        nAdds += files.size();
+    putU32(payload, nAdds);
+    for (uint32_t level = 0; level < levels.size(); ++level) {
+        for (auto &name : levels[level]) {
+            putU32(payload, level);
+            putName(payload, name);
+        }
+    }
+    putU32(payload, 0);
+    records = 0;
+    append(payload);
+    fclose(file);
+    std::rename(tmp.c_str(), path.c_str()); // 快照完整写出后再替换旧日志
+    file = fopen(path.c_str(), "ab");
+}
+
+void manifest::logEdit(const std::vector<std::pair<int, std::string>> &adds, const std::vector<std::string> &dels) {
+    if (file == NULL)
+        return;
+    std::string payload;
+    putU32(payload, adds.size());
+    for (auto &it : adds) {
+        putU32(payload, it.first);
+        putName(payload, it.second);
+    }
+    putU32(payload, dels.size());
+    for (auto &name : dels)
+        putName(payload, name);
+    append(payload);
+}
+
+void manifest::close() {
+    if (file != NULL)
+        fclose(file);
+    file = nullptr;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#ifndef LSM_KV_MANIFEST_H
+#define LSM_KV_MANIFEST_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * MANIFEST：记录每一层有哪些 sstable 的 version edit 日志。
+ * 每条记录为 [len u32][payload][checksum u32]，payload 为
+ *   [nAdds u32] nAdds * ([level u32][nameLen u32][name])
+ *   [nDels u32] nDels * ([nameLen u32][name])
+ * 启动时按顺序重放；末尾写了一半的记录校验失败，直接丢弃。
+ * 新 sstable 先写完再记日志，日志落盘之后才删除旧文件，所以日志里的文件一定完整存在。
+ */
+const uint32_t MANIFEST_REWRITE = 1024; // 日志条数超过这个值时重写成一份快照
+
+class manifest {
+private:
+    std::string path;
+    FILE *file       = nullptr;
+    uint32_t records = 0;
+
+    void append(const std::string &payload);
+
+public:
+    ~manifest() {
+        close();
+    }
+
+    // 重放 path 处的日志，得到每一层存活的文件；没有日志返回 false
+    static bool recover(const std::string &path, std::vector<std::vector<std::string>> &levels);
+
+    // 把当前每一层的文件写成一条快照记录，替换原日志，之后的 edit 追加在它后面
+    void open(const std::string &path, const std::vector<std::vector<std::string>> &levels);
+    void logEdit(const std::vector<std::pair<int, std::string>> &adds, const std::vector<std::string> &dels);
+    void close();
+
+    uint32_t getRecords() const {
+        return records;
+    }
+};
+
+#endif // LSM_KV_MANIFEST_H
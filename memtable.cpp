@@ -0,0 +1,77 @@
+#include "memtable.h"
+
+#include "artmemtable.h"
+#include "hashmemtable.h"
+#include "skiplist.h"
+#include "vectormemtable.h"
+
+#include <cstring>
+
+std::string_view memtable::view(const char *rec) {
+    if (!rec)
+        return std::string_view();
+    uint32_t len;
+    std::memcpy(&len, rec, 4);
+    return std::string_view(rec + 4, len);
+}
+
+const char *memtable::newValue(std::string_view val) {
+    char *rec    = mem.allocate(4 + val.length());
+    uint32_t len = val.length();
+    std::memcpy(rec, &len, 4);
+    std::memcpy(rec + 4, val.data(), len);
+    return rec;
+}
+
+// 从无到有计一条记录，从有到无减一条
+int64_t memtable::account(const char *old, const char *rec) {
+    uint32_t delta = 0;
+    if (old)
+        delta -= 12 + view(old).length();
+    if (rec)
+        delta += 12 + view(rec).length();
+    bytes.fetch_add(delta, std::memory_order_relaxed); // 无符号回绕，等价于加上有符号的差
+    return old ? (int64_t)view(old).length() : -1;
+}
+
+void memtable::clearRangeDels() {
+    std::lock_guard<std::mutex> guard(delsLock);
+    delsHistory.clear();
+    delsHistory.emplace_back(new rangedel);
+    dels = delsHistory.back().get();
+}
+
+// 先发布删除区间再删 key：否则并发的读者可能在 memtable 中找不到 key，又没看到删除区间，读到更旧的表里的值
+void memtable::delRange(uint64_t key1, uint64_t key2) {
+    {
+        std::lock_guard<std::mutex> guard(delsLock);
+        delsHistory.emplace_back(new rangedel(*dels.load(std::memory_order_relaxed)));
+        delsHistory.back()->add(key1, key2);
+        dels.store(delsHistory.back().get(), std::memory_order_release);
+    }
+    removeRange(key1, key2);
+}
+
+void memtable::reset() {
+    mem.reset(); // 一次释放所有节点
+    bytes = 0;
+    clearRangeDels();
+    init();
+}
+
+uint32_t memtable::getBytes() const {
+    return bytes + 16 * getRangeDels().size(); // 删除区间落盘时每个占 16 字节
+}
+
+std::shared_ptr<memtable> newMemtable(memtableKind kind) {
+    switch (kind) {
+    case MEMTABLE_VECTOR:
+        return std::make_shared<vectormemtable>();
+    case MEMTABLE_HASH:
+        return std::make_shared<hashmemtable>();
+    case MEMTABLE_ART:
+        return std::make_shared<artmemtable>();
+    default:
+        return std::make_shared<skiplist>(0.5);
+    }
+}
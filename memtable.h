@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef LSM_KV_MEMTABLE_H
+#define LSM_KV_MEMTABLE_H
+
+#include "arena.h"
+#include "rangedel.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * memtable 的公共接口。不同负载适合不同的实现，每个 KVStore 用 setMemtableKind 选择：
+ * 除 reset 外的所有操作都可以由多个线程同时调用，各实现自己决定是否加锁。
+ * value 存成 arena 中的 [len u32][bytes]，写入之后不再修改，覆盖时另外分配；所有内存随 arena 在 memtable 销毁时释放。
+ */
+enum memtableKind {
+    MEMTABLE_SKIPLIST, // 默认：并发跳表，插入用 CAS，读者不加锁
+    MEMTABLE_VECTOR,   // 批量导入：追加到数组末尾，第一次读或落盘时排序，适合写完再读的负载
+    MEMTABLE_HASH,     // 点查为主：哈希桶 + 链表，get 为 O(1)，scan 和落盘时才排序
+    MEMTABLE_ART,      // 自适应基数树：按 uint64 的 8 个字节逐层分支，节点按孩子数在 4/16/48/256 之间扩展
+};
+
+using memtableVisitor = std::function<void(uint64_t key, std::string_view val)>;
+
+class memtable {
+private:
+    // deleteRange 写入的删除区间，只覆盖比这个 memtable 旧的数据。写时复制：读者拿到的版本不会再被修改，
+    // 旧版本留在 delsHistory 中直到 reset
+    std::atomic<const rangedel *> dels{nullptr};
+    std::vector<std::unique_ptr<rangedel>> delsHistory;
+    std::mutex delsLock; // 串行化 addRangeDel 中的复制
+
+    void clearRangeDels();
+
+protected:
+    arena mem;                      // 节点和 value 都从这里分配，reset 时整体释放
+    std::atomic<uint32_t> bytes{0}; // 落盘后 sstable 中 index + data 区域的字节数，不含被覆盖的旧 value
+
+    const char *newValue(std::string_view val);
+    int64_t account(const char *old, const char *rec); // 一个 key 的 value 从 old 换成 rec，空指针表示不存在；返回旧 value 的长度或 -1
+    virtual void init() = 0;                        // arena 清空之后重建空的索引
+    virtual void removeRange(uint64_t key1, uint64_t key2) = 0; // 删掉区间内已有的 key
+
+public:
+    memtable() {
+        clearRangeDels();
+    }
+
+    virtual ~memtable() = default;
+    memtable(const memtable &) = delete;
+    memtable &operator=(const memtable &) = delete;
+
+    static std::string_view view(const char *rec); // rec 为空时 data() 为空
+
+    // 插入或覆盖，在同一次查找中返回旧 value 的长度，原来没有这个 key（或已删除）时返回 -1
+    virtual int64_t upsert(uint64_t key, std::string_view val) = 0;
+    virtual std::string search(uint64_t key) = 0; // 不存在或已删除时返回空串
+    virtual bool del(uint64_t key) = 0;
+    virtual void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) = 0; // 按 key 升序
+    virtual void forEach(const memtableVisitor &visit) = 0; // 按 key 升序访问所有未删除的 key，落盘时调用
+
+    virtual size_t getMemoryUsage() const { // 实际占用的内存，包括被覆盖、删除的 value
+        return mem.getUsage();
+    }
+
+    // 区间内已有的 key 直接删掉，再记下删除区间，之后插入的 key 比这次删除新，不受它影响
+    void delRange(uint64_t key1, uint64_t key2);
+    void reset(); // 不能与其他操作并发
+    uint32_t getBytes() const;
+
+    const rangedel &getRangeDels() const {
+        return *dels.load(std::memory_order_acquire);
+    }
+};
+
+std::shared_ptr<memtable> newMemtable(memtableKind kind);
+
+#endif // LSM_KV_MEMTABLE_H
@@ -0,0 +1,64 @@
+#include "rangedel.h"
+
+#include <algorithm>
+#include <cstring>
+
+void rangedel::add(uint64_t start, uint64_t end) {
+    if (start > end)
+        return;
+    // 第一个与 [start, end] 相交或相邻的区间
+    auto first = std::lower_bound(frags.begin(), frags.end(), start, [](const RangeTombstone &t, uint64_t key) {
+        return t.end < key && t.end + 1 < key;
+    });
+    auto last = first;
+    while (last != frags.end() && (last->start <= end || last->start - 1 <= end)) {
+        start = std::min(start, last->start);
+        end   = std::max(end, last->end);
+        ++last;
+    }
+    first = frags.erase(first, last);
+    frags.insert(first, RangeTombstone(start, end));
+}
+
+void rangedel::add(const rangedel &other) {
+    for (auto &it : other.frags)
+        add(it.start, it.end);
+}
+
+bool rangedel::covers(uint64_t key) const {
+    auto it = std::upper_bound(frags.begin(), frags.end(), key,
+                               [](uint64_t key, const RangeTombstone &t) { return key < t.start; });
+    return it != frags.begin() && (it - 1)->end >= key;
+}
+
+bool rangedel::overlaps(uint64_t start, uint64_t end) const {
+    auto it = std::lower_bound(frags.begin(), frags.end(), start,
+                               [](const RangeTombstone &t, uint64_t key) { return t.end < key; });
+    return it != frags.end() && it->start <= end;
+}
+
+rangedel rangedel::clip(uint64_t lo, uint64_t hi) const {
+    rangedel res;
+    for (auto &it : frags) {
+        if (it.end < lo || it.start > hi)
+            continue;
+        res.frags.emplace_back(std::max(it.start, lo), std::min(it.end, hi));
+    }
+    return res;
+}
+
+void rangedel::encode(std::string &buf) const {
+    for (auto &it : frags) {
+        buf.append(reinterpret_cast<const char *>(&it.start), 8);
+        buf.append(reinterpret_cast<const char *>(&it.end), 8);
+    }
+}
+
+void rangedel::decode(const unsigned char *buf, uint32_t cnt) {
+    frags.resize(cnt);
+    for (auto &it : frags) {
+        std::memcpy(&it.start, buf, 8);
+        std::memcpy(&it.end, buf + 8, 8);
+        buf += 16;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef LSM_KV_RANGEDEL_H
+#define LSM_KV_RANGEDEL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * 范围删除：memtable 和 sstable 各自带一组删除区间。
+ * 一个来源（memtable / sstable）的删除区间只作用于比它旧的来源，不作用于它自己的数据：
+ * deleteRange 写入时会先删掉 memtable 中落在区间内的 key，之后再写入的 key 比删除新，
+ * compaction 合并时也只用较新输入的区间过滤较旧输入的数据。
+ */
+struct RangeTombstone {
+    uint64_t start, end; // 闭区间 [start, end]
+
+    RangeTombstone() {}
+
+    RangeTombstone(uint64_t start, uint64_t end) {
+        this->start = start;
+        this->end   = end;
+    }
+};
+
+// 互不相交、按 start 排序的一组删除区间，相交或相邻的区间在加入时合并
+class rangedel {
+private:
+    std::vector<RangeTombstone> frags;
+
+public:
+    void add(uint64_t start, uint64_t end);
+    void add(const rangedel &other);
+    bool covers(uint64_t key) const;
+    bool overlaps(uint64_t start, uint64_t end) const;
+    rangedel clip(uint64_t lo, uint64_t hi) const; // 与 [lo, hi] 的交
+
+    void encode(std::string &buf) const; // 每个区间 16 字节
+    void decode(const unsigned char *buf, uint32_t cnt);
+
+    void clear() {
+        frags.clear();
+    }
+
+    bool empty() const {
+        return frags.empty();
+    }
+
+    uint32_t size() const {
+        return frags.size();
+    }
+
+    uint64_t getMin() const {
+        return frags.front().start;
+    }
+
+    uint64_t getMax() const {
+        return frags.back().end;
+    }
+
+    const std::vector<RangeTombstone> &getFrags() const {
+        return frags;
+    }
+};
+
+#endif // LSM_KV_RANGEDEL_H
@@ -1,139 +1,147 @@
-#include <cstdint>
-#include <limits>
-#include <list>
-#include <string>
-#include <vector>
-
 #include "skiplist.h"
 
-double skiplist::my_rand()
-{
-    int S = 0xFFFF, PS = S * p;
-    return rand() & S;
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <random>
+#include <thread>
+
+slnode *skiplist::newNode(uint64_t key, std::string_view val, TYPE type, int height) {
+    size_t links = offsetof(slnode, nxt) + sizeof(std::atomic<slnode *>) * height;
+    char *buf    = mem.allocate(links + 4 + val.length());
+    slnode *node = new (buf) slnode;
+    node->key    = key;
+    node->type   = type;
+    node->height = height;
+    for (int i = 0; i < height; ++i)
+        new (&node->nxt[i]) std::atomic<slnode *>(nullptr);
+    uint32_t len = val.length();
+    std::memcpy(buf + links, &len, 4);
+    std::memcpy(buf + links + 4, val.data(), len);
+    node->val.store(buf + links, std::memory_order_relaxed); // 节点挂入链表时随 CAS 一起发布
+    return node;
 }
-int skiplist::randLevel()
-{
-    int lv = 1; 
-    int S = 0xFFFF, PS = S * p;
-    while (my_rand()< PS) 
-        ++lv; 
-    curMaxL = std::min(MAX_LEVEL, lv); 
-    return curMaxL; 
+
+int64_t skiplist::setValue(slnode *node, const char *rec) {
+    return account(node->val.exchange(rec, std::memory_order_acq_rel), rec);
 }
-void skiplist::insert(uint64_t key, const std::string &str)
-{
-    std::vector<slnode*> update(MAX_LEVEL);
-	slnode *cur = head;
-    if(cur==nullptr)
-        return;
-	for(int i = curMaxL-1; i >= 0; --i){
-		//一旦大了就下移一层
-		while(cur->nxt[i]->key < key){
-			cur = cur->nxt[i];
-		}
-		update[i] = cur;
-	}
-    if (cur->nxt[0]->key == key && cur->nxt[0]->type == NORMAL) {
-        bytes = bytes - cur->nxt[0]->val.length() + str.length();  //要更新一下bytes 
-        cur->nxt[0]->val = str;
-        return;
+
+// 从 before 开始在 level 层找 key 的位置，返回最后一个小于 key 的节点，after 为它的后继
+slnode *skiplist::findSplice(uint64_t key, slnode *before, int level, slnode **after) {
+    while (true) {
+        slnode *next = before->next(level);
+        if (next->key < key) {
+            before = next;
+            continue;
+        }
+        *after = next;
+        return before;
     }
-	slnode *newNode = new slnode(key, str, NORMAL);
-    for(int i = 0; i < curMaxL; ++i){
-		newNode->nxt[i] = update[i]->nxt[i];
-		update[i]->nxt[i] = newNode;
-	}
-    bytes += 12+str.length();
-	return;
 }
-std::string skiplist::search(uint64_t key)
-{
-    slnode *cur = head;
-    for(int i = curMaxL-1; i >= 0; --i){
-        while(cur->nxt[i]->key < key){
-            cur = cur->nxt[i];
-        }
-    }   
-    cur = cur->nxt[0];
-    if(cur->key == key && cur->type == NORMAL){
-        return cur->val;
+
+void skiplist::init() {
+    curMaxL = 1;
+    head    = newNode(0, "", HEAD, MAX_LEVEL);
+    tail    = newNode(INF, "", TAIL, 1);
+    for (int i = 0; i < MAX_LEVEL; ++i) {
+        head->nxt[i].store(tail, std::memory_order_relaxed);
+        finger[i].store(head, std::memory_order_relaxed);
     }
-    return "";
 }
 
-bool skiplist::del(uint64_t key, uint32_t len)
-{
+int skiplist::randLevel() {
+    static thread_local std::minstd_rand rng(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    int lv             = 1;
+    uint32_t threshold = p * 0xFFFF;
+    while (lv < MAX_LEVEL && (rng() >> 8 & 0xFFFF) < threshold)
+        ++lv;
+    return lv;
+}
+
+int64_t skiplist::upsert(uint64_t key, std::string_view val) {
+    slnode *prev[MAX_LEVEL], *next[MAX_LEVEL];
+    int maxL    = curMaxL.load(std::memory_order_relaxed);
     slnode *cur = head;
-    std::vector<slnode*> update(MAX_LEVEL);
-    for(int i = curMaxL-1; i >= 0; --i){
-        while(cur->nxt[i]->key < key){
-            cur = cur->nxt[i];
-        }
-        update[i] = cur;
+    for (int i = MAX_LEVEL - 1; i >= maxL; --i) {
+        prev[i] = head;
+        next[i] = tail;
+    }
+    bool ascending = finger[0].load(std::memory_order_acquire)->key < key; // 不比上一次插入的 key 大时不用 finger
+    for (int i = maxL - 1; i >= 0; --i) {
+        slnode *f = ascending ? finger[i].load(std::memory_order_acquire) : head;
+        if (f->key < key && f->key > cur->key) // 比上一层找到的前驱更近，从它开始
+            cur = f;
+        cur = prev[i] = findSplice(key, cur, i, &next[i]);
     }
-    cur = cur->nxt[0];
-    if(cur->key == key && cur->type == NORMAL){
-        for(int i = 0; i < curMaxL; ++i){
-            if(update[i]->nxt[i] != cur){
+    if (next[0]->key == key && next[0]->type == NORMAL) {
+        for (int i = 0; i < maxL; ++i)
+            finger[i].store(prev[i], std::memory_order_release);
+        return setValue(next[0], newValue(val)); // 已经有这个 key，只替换 value
+    }
+    int height = randLevel();
+    while (height > maxL && !curMaxL.compare_exchange_weak(maxL, height, std::memory_order_relaxed))
+        ;
+    slnode *node = newNode(key, val, NORMAL, height);
+    for (int i = 0; i < height; ++i) {
+        while (true) {
+            node->nxt[i].store(next[i], std::memory_order_relaxed);
+            if (prev[i]->nxt[i].compare_exchange_strong(next[i], node, std::memory_order_release))
                 break;
-            }
-            update[i]->nxt[i] = cur->nxt[i];
+            // 前驱之后插入了新节点，从前驱开始重新找这一层的位置
+            prev[i] = findSplice(key, prev[i], i, &next[i]);
+            if (i == 0 && next[0]->key == key && next[0]->type == NORMAL) // 别的线程先插入了同一个 key，node 还没有挂上，直接丢弃
+                return setValue(next[0], node->val.load(std::memory_order_relaxed));
         }
-        bytes -= 12+len;
-        delete cur;
-        return true;
     }
+    for (int i = 0; i < maxL; ++i) // maxL 不小于 height，更高的层 finger 总是 head
+        finger[i].store(i < height ? node : prev[i], std::memory_order_release);
+    return account(nullptr, node->val.load(std::memory_order_relaxed));
+}
 
+std::string skiplist::search(uint64_t key) {
+    slnode *cur = lowerBound(key);
+    if (cur->key == key && cur->type == NORMAL)
+        return std::string(cur->value());
+    return "";
 }
 
-void skiplist::scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list)
-{
-    slnode *Lnode = lowerBound(key1);
-    slnode *Rnode = lowerBound(key2);
-    if(Lnode->key<=Rnode->key&& Rnode->key<= tail->key)
-    {
-        slnode *cur = Lnode;
-        while(cur!=Rnode){
-            if(cur->type == NORMAL){
-                //if(cur->key<=key2&&cur->key>=key1)
-                    list.push_back(std::pair<uint64_t, std::string>(cur->key, cur->val));
-            }
-            cur = cur->nxt[0];
-        }
-        if(key2==Rnode->key)
-            list.push_back(std::pair<uint64_t,std::string>(Rnode->key,Rnode->val));
+bool skiplist::del(uint64_t key) {
+    slnode *cur = lowerBound(key);
+    if (cur->key != key || cur->type != NORMAL || cur->removed())
+        return false;
+    setValue(cur, nullptr); // 节点的空间随 arena 一起释放
+    return true;
+}
+
+void skiplist::removeRange(uint64_t key1, uint64_t key2) {
+    for (slnode *cur = lowerBound(key1); cur->type == NORMAL && cur->key <= key2; cur = cur->next(0)) {
+        if (!cur->removed())
+            setValue(cur, nullptr);
     }
-    return;
+}
 
+void skiplist::scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) {
+    for (slnode *cur = lowerBound(key1); cur->type == NORMAL && cur->key <= key2; cur = cur->next(0)) {
+        std::string_view val = cur->value();
+        if (val.data())
+            list.emplace_back(cur->key, std::string(val));
+    }
 }
-slnode *skiplist::lowerBound(uint64_t key)
-{
-    slnode *cur = head;
-    for(int i = curMaxL-1; i >= 0; --i){
-        while(cur->nxt[i]->key < key){
-            cur = cur->nxt[i];
-        }
+
+void skiplist::forEach(const memtableVisitor &visit) {
+    for (slnode *cur = getFirst(); cur->type == NORMAL; cur = cur->next(0)) {
+        std::string_view val = cur->value();
+        if (val.data())
+            visit(cur->key, val);
     }
-    return cur->nxt[0];
 }
-void skiplist::reset()
-{
-    slnode *cur = head->nxt[0];
-    while(cur->type != TAIL){
-        slnode *tmp = cur->nxt[0];
-        delete cur;
-        cur = tmp;
+
+slnode *skiplist::lowerBound(uint64_t key) {
+    slnode *cur = head;
+    for (int i = curMaxL.load(std::memory_order_relaxed) - 1; i >= 0; --i) {
+        while (cur->next(i)->key < key)
+            cur = cur->next(i);
     }
-    delete head;
-    delete tail;    
-    head = new slnode(0, "", HEAD);
-    tail = new slnode(INF, "", TAIL);
-    for (int i = 0; i < MAX_LEVEL; ++i)
-        head->nxt[i] = tail;  
-    bytes = 0x0;
-    curMaxL = 1;
+    return cur->next(0);
 }
-uint32_t skiplist::getBytes()
-{
-    return bytes;
-}
\ No newline at end of file
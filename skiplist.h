@@ -1,9 +1,13 @@
 #ifndef LSM_KV_SKIPLIST_H
 #define LSM_KV_SKIPLIST_H
+#include "memtable.h"
+
+#include <atomic>
 #include <cstdint>
 #include <limits>
 #include <list>
 #include <string>
+#include <string_view>
 #include <vector>
 
 enum TYPE {
@@ -13,56 +17,71 @@ enum TYPE {
 };
 
 const int MAX_LEVEL = 18;
-// slnode是skiplist里面的每个节点
+// slnode是skiplist里面的每个节点，从 arena 中分配：nxt 的实际长度为 height，初始的 value 紧跟在 nxt 之后。
+// val 为空表示已被删除，节点留在链表中
 class slnode {
 public:
     uint64_t key;
-    std::string val;
+    std::atomic<const char *> val;
     TYPE type;
-    std::vector<slnode *> nxt;
+    int height;
+    std::atomic<slnode *> nxt[1];
+
+    slnode *next(int level) const {
+        return nxt[level].load(std::memory_order_acquire);
+    }
 
-    slnode(uint64_t key, const std::string &val, TYPE type) {
-        this->key  = key;
-        this->val  = val;
-        this->type = type;
-        for (int i = 0; i < MAX_LEVEL; ++i)
-            nxt.push_back(nullptr);
+    // 已删除时 data() 为空
+    std::string_view value() const {
+        return memtable::view(val.load(std::memory_order_acquire));
+    }
+
+    bool removed() const {
+        return val.load(std::memory_order_acquire) == nullptr;
     }
 };
 
-class skiplist {
+/*
+ * 并发跳表：insert / del / delRange 可以由多个线程同时调用，读者不加锁。
+ * 插入先用 CAS 挂到第 0 层，再自下而上挂到各层，CAS 失败时从前驱开始重新找这一层的位置。
+ * 节点不会从链表中摘下，所有内存随 arena 在 memtable 销毁时一起释放。
+ */
+class skiplist : public memtable {
 private:
     const uint64_t INF = std::numeric_limits<uint64_t>::max();
     double p; // p 表示增长概率
-    uint64_t s     = 1;
-    uint32_t bytes = 0x0; // bytes表示index + data区域的字节数，即跳表占用的内存大小。初始为0，随着数据插入会增加。
-    int curMaxL    = 1; //表示当前跳表的最大层级，初始为1层。随着元素的插入和随机层级的生成，这个值可能会增加，但不会超过MAX_LEVEL(18)。
-    slnode *head   = new slnode(0, "", HEAD);
-    slnode *tail   = new slnode(INF, "", TAIL);
+    std::atomic<int> curMaxL{1}; //表示当前跳表的最大层级，初始为1层。随着元素的插入和随机层级的生成，这个值可能会增加，但不会超过MAX_LEVEL(18)。
+    slnode *head;
+    slnode *tail;
+    // 上一次插入时每一层的前驱（新节点所在的层为新节点本身）。节点不会摘下，任何一个 key 小于目标的节点都是合法的起点，
+    // key 递增写入时从这里开始找，不必每次从 head 的最高层往下走；多个写者覆盖彼此的值也只影响快慢
+    std::atomic<slnode *> finger[MAX_LEVEL];
+
+    slnode *newNode(uint64_t key, std::string_view val, TYPE type, int height);
+    int64_t setValue(slnode *node, const char *rec); // rec 为空时删除，返回旧 value 的长度或 -1
+    slnode *findSplice(uint64_t key, slnode *before, int level, slnode **after);
+
+protected:
+    void init() override;
+    void removeRange(uint64_t key1, uint64_t key2) override;
 
 public:
     skiplist(double p) { // p 表示增长概率
-        s       = 1;
-        bytes   = 0x0;
-        curMaxL = 1;
         this->p = p;
-        for (int i = 0; i < MAX_LEVEL; ++i)
-            head->nxt[i] = tail;
+        init();
     }
 
     slnode *getFirst() {
-        return head->nxt[0];
+        return head->next(0);
     }
 
-    double my_rand();
     int randLevel();
-    void insert(uint64_t key, const std::string &str);
-    std::string search(uint64_t key);
-    bool del(uint64_t key, uint32_t len);
-    void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list);
+    int64_t upsert(uint64_t key, std::string_view val) override;
+    std::string search(uint64_t key) override;
+    bool del(uint64_t key) override;
+    void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) override;
+    void forEach(const memtableVisitor &visit) override;
     slnode *lowerBound(uint64_t key);
-    void reset();
-    uint32_t getBytes();
 };
 
 #endif // LSM_KV_SKIPLIST_H
@@ -4,126 +4,115 @@
 #include "utils.h"
 
 #include <iostream>
-const uint32_t MAXSIZE = 2 * 1024 * 1024; // 2MB
 
 /*
  *  在path路径下创建一个新的sstable，时间戳为缓存sstable的时间戳
  * */
-void sstable::putFile(const char *path) { // 将内存中的输出到二进制文件中
+bool sstable::putFile(const char *path) { // 将内存中的输出到二进制文件中
     // std::cout << "output path" << path << std::endl;
     FILE *file = fopen(path, "wb");
     if (file == NULL) {
         std::cerr << "Failed to open file: " << path << std::endl;
         std::cerr << "Error: " << strerror(errno) << std::endl;
-        return;
+        return false;
     }
-    fseek(file, 0, SEEK_SET);
-    // 4个u64变量
-    fwrite(&time, 8, 1, file);
-    fwrite(&cnt, 8, 1, file);
-    fwrite(&minV, 8, 1, file);
-    fwrite(&maxV, 8, 1, file);
-    for (int i = 0; i < 8 * M; i += 8) { // bloom
-        unsigned char cur = 0x0;
-        for (int j = 0; j < 8; ++j)
-            cur |= (filter.getBit(i + j) << j);
-        fwrite(&cur, 1, 1, file);
-    }
-    int size = index.size();
-    for (int i = 0; i < size; ++i) { // index
-        uint64_t key    = index[i].key;
-        uint32_t offset = index[i].offset;
-        fwrite(&key, 8, 1, file);
-        fwrite(&offset, 4, 1, file);
-    }
-    size = data.size();
-    for (int i = 0; i < size; ++i) { // datas
-        fwrite(data[i].data(), 1, data[i].length(), file);
+    bool ok = true;
+    if (format == FORMAT_BLOCK) {
+        ok = putBlocks(file);
+    } else {
+        // 4个u64变量
+        ok &= fwrite(&time, 8, 1, file) == 1;
+        ok &= fwrite(&cnt, 8, 1, file) == 1;
+        ok &= fwrite(&minV, 8, 1, file) == 1;
+        ok &= fwrite(&maxV, 8, 1, file) == 1;
+        std::vector<unsigned char> bits(filter.size()); // bloom
+        filter.dumpBytes(bits.data());
+        ok &= fwrite(bits.data(), 1, bits.size(), file) == bits.size();
+        for (auto &it : index) { // index
+            uint64_t key    = it.key;
+            uint32_t offset = it.offset;
+            ok &= fwrite(&key, 8, 1, file) == 1;
+            ok &= fwrite(&offset, 4, 1, file) == 1;
+        }
+        for (auto &it : data) // datas
+            ok &= fwrite(it.data(), 1, it.length(), file) == it.length();
     }
-    fflush(file); // 清空缓冲区
-    fclose(file);
+    ok &= utils::syncFile(file) == 0; // 记入 MANIFEST 之前表必须已经落盘
+    ok &= fclose(file) == 0;
+    if (!ok)
+        std::perror(path);
+    return ok;
 }
 
-char buf[2097152];
-
-void sstable::loadFile(const char *path) { // load file from the path
-    filename = path;
-    int len = std::strlen(path), c = 0;
-    std::string suf;
-    for (int i = 0; i < len; ++i) {
-        if (c == 2)
-            suf += path[i];
-        if (path[i] == '-') {
-            c++;
-        }
-        if (path[i] == '.')
-            c = 0;
-    }
-    if (suf.size())
-        nameSuffix = std::stoi(suf);
-    else
-        nameSuffix = 0;
-    FILE *file = fopen(path, "rb+");
-    fseek(file, 0, SEEK_SET); // 移动到开头
-    reset();
-    fread(&time, 8, 1, file);
-    fread(&cnt, 8, 1, file);
-    fread(&minV, 8, 1, file);
-    fread(&maxV, 8, 1, file);
-    for (int i = 0; i < 8 * M; i += 8) { // bloom
-        unsigned char cur = 0x0;
-        fread(&cur, 1, 1, file);
-        for (int j = 0; j < 8; ++j) {
-            if ((cur >> j) & 1)
-                filter.setBit(i + j);
+/*
+ *  块格式：value 按 BLOCK_SIZE 切成对齐的 data block，之后依次是 bloom、稀疏 block index 和 footer
+ *  整个文件先在内存中拼好，再一次写出
+ * */
+bool sstable::putBlocks(FILE *file) {
+    std::string buf, cur;
+    blocks.clear();
+    for (uint64_t i = 0; i < cnt; ++i) {
+        if (cur.size() && cur.size() + 12 + data[i].length() > BLOCK_SIZE) { // 放不下，先结束当前块
+            blocks.emplace_back(index[i - 1].key, buf.size(), cur.size());
+            buf += cur;
+            buf.resize((buf.size() + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE, '\0'); // 下一个块按 BLOCK_SIZE 对齐
+            cur.clear();
         }
+        block::append(cur, index[i].key, data[i]);
     }
-    bytes = 10240 + 32 + 12 * cnt;
-    Index temp;
-    for (int i = 0; i < cnt; ++i) { // index
-        fread(&temp.key, 8, 1, file);
-        fread(&temp.offset, 4, 1, file);
-        index.push_back(temp);
+    if (cur.size()) {
+        blocks.emplace_back(index[cnt - 1].key, buf.size(), cur.size());
+        buf += cur;
     }
-    bytes += temp.offset;
-    std::string cur; // data
-    fread(buf, 1, index[0].offset, file);
-    buf[index[0].offset] = '\0';
-    cur                  = buf;
-    data.push_back(cur);
-    for (int i = 1; i < cnt; ++i) {
-        fread(buf, 1, index[i].offset - index[i - 1].offset, file);
-        buf[index[i].offset - index[i - 1].offset] = '\0';
-        cur                                        = buf;
-        data.push_back(cur);
+
+    Footer footer;
+    footer.time        = time;
+    footer.cnt         = cnt;
+    footer.minV        = minV;
+    footer.maxV        = maxV;
+    footer.metaOffset  = buf.size();
+    footer.blockCnt    = blocks.size();
+    footer.version     = FORMAT_BLOCK;
+    footer.rangeDelCnt = rangeDels.size();
+
+    size_t pos = buf.size();
+    buf.resize(pos + filter.size());
+    filter.dumpBytes(reinterpret_cast<unsigned char *>(&buf[pos]));
+    for (auto &it : blocks) {
+        buf.append(reinterpret_cast<const char *>(&it.lastKey), 8);
+        buf.append(reinterpret_cast<const char *>(&it.offset), 4);
+        buf.append(reinterpret_cast<const char *>(&it.size), 4);
     }
-    fflush(file);
-    fclose(file);
+    rangeDels.encode(buf);
+    footer.encode(buf);
+    return fwrite(buf.data(), 1, buf.size(), file) == buf.size();
 }
 
 bloom sstable::copyFilter() {
-    bloom *res = new bloom;
-    res->setBitset(filter.getBitset());
-    return *res;
+    return filter;
 }
 
 std::vector<Index> sstable::copyIndexs() {
-    std::vector<Index> *res = new std::vector<Index>(index);
-    return *res;
+    return index;
 }
 
-sstablehead sstable::getHead() {
-    auto *res = new sstablehead;
-    res->setFilename(filename);
-    res->setNamesuffix(nameSuffix);
-    res->setTime(time);
-    res->setCnt(cnt);
-    res->setMinV(minV);
-    res->setMaxV(maxV);
-    res->setBytes(bytes);
-    res->setFilter(filter);
-    res->setIndex(index);
-    return *res;
+sstablehead sstable::getHead() { // 按值返回，不再 new 出来之后泄漏
+    sstablehead res;
+    res.setFilename(filename);
+    res.setNamesuffix(nameSuffix);
+    res.setTime(time);
+    res.setCnt(cnt);
+    res.setMinV(minV);
+    res.setMaxV(maxV);
+    res.setBytes(bytes);
+    res.setFilter(filter);
+    res.setFormat(format);
+    res.setRangeDels(rangeDels);
+    if (format == FORMAT_BLOCK)
+        res.setBlocks(blocks); // 块格式只在内存中保留稀疏的 block index
+    else
+        res.setIndex(index);
+    return res;
 }
 
 // 向sstable尾部插一个key-val对，同时修改头和bloom filter
@@ -137,15 +126,3 @@ void sstable::insert(uint64_t key, const std::string &val) {
     filter.insert(key);
     data.push_back(val);
 }
-
-bool sstable::checkSize(std::string val, int curLevel, int flag) {
-    uint32_t nxtBytes = bytes + 12 + val.length();
-    if (flag || nxtBytes > MAXSIZE) {
-        std::string url = std::string("./data/level-") + std::to_string(curLevel) + "/";
-        url += std::to_string(time) + "-" + std::to_string(++nameSuffix) + ".sst";
-        filename = url;
-        putFile(url.data());
-        return true;
-    }
-    return false;
-}
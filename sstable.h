@@ -3,14 +3,16 @@
 #ifndef LSM_KV_SSTABLE_H
 #define LSM_KV_SSTABLE_H
 #include "bloom.h"
-#include "skiplist.h"
+#include "memtable.h"
 #include "sstablehead.h"
 #include <cstdint>
+#include <functional>
 #include <vector>
 #include <limits>
-static uint64_t TIME = 0;                     // 全局时间戳
 const uint64_t INF   = std::numeric_limits<uint64_t>::max();
 
+using valueMapper = std::function<std::string(uint64_t key, const std::string &val)>; // 落盘时替换写入表中的 value
+
 class sstable : public sstablehead { // 储存sstable的软数据结构
 private:
     std::vector<std::string> data; //只多了一个数据区
@@ -22,8 +24,12 @@ public:
         minV   = INF;
         maxV   = 0;
         bytes  = 10240 + 32;
+        format = FORMAT_BLOCK;
         filter.reset();
         index.clear();
+        blocks.clear();
+        rangeDels.clear();
+        rangeDelCnt = 0;
         data.clear();
     }
 
@@ -34,37 +40,48 @@ public:
         minV   = INF;
         maxV   = 0;
         bytes  = 10240 + 32;
+        format = FORMAT_BLOCK; // 新生成的 sstable 默认写块格式
         filter.reset();
         index.clear();
+        blocks.clear();
         data.clear();
     }
 
-    sstable(skiplist *s) { // 将一个memtable转成sstable， 这里时间戳加1 因为生成一个新的sstable只有可能是从memtable转成sstable。
+    // 将一个memtable转成sstable，文件放在 dir 下，以时间戳 time 命名
+    sstable(memtable *s, const std::string &dir, uint64_t time, filterPolicy policy = filterPolicy(),
+            const valueMapper &mapValue = nullptr) {
         reset();
-        curpos      = 0;
-        bytes       = 10240 + 32 + s->getBytes();
-        time        = ++TIME;
-        filename    = "./data/level-0/" + std::to_string(TIME) + ".sst"; // 初始的文件名就是时间戳
-        cnt         = 0;
-        minV        = INF;
-        maxV        = 0;
-        slnode *cur = s->getFirst();
-        while (cur->type != TAIL) { // curpos 为这个串的终止地址
+        filter.reset(policy); // 块格式按 policy 选过滤器，所有 key 加入之后按 key 数分配
+        curpos   = 0;
+        bytes    = 10240 + 32 + 16 * s->getRangeDels().size();
+        this->time = time;
+        filename = dir + "/" + std::to_string(time) + ".sst"; // 初始的文件名就是时间戳
+        cnt      = 0;
+        minV     = INF;
+        maxV     = 0;
+        s->forEach([&](uint64_t key, std::string_view raw) { // curpos 为这个串的终止地址
             cnt++;
-            curpos += cur->val.length();
-            minV = std::min(minV, cur->key);
-            maxV = std::max(maxV, cur->key);
-            filter.insert(cur->key);
-            index.emplace_back(cur->key, curpos);
-            data.push_back(cur->val);
-            cur = cur->nxt[0];
+            std::string val(raw);
+            if (mapValue)
+                val = mapValue(key, val); // 键值分离时换成 value log 中的指针
+            bytes += 12 + val.length();
+            curpos += val.length();
+            minV = std::min(minV, key);
+            maxV = std::max(maxV, key);
+            filter.insert(key);
+            index.emplace_back(key, curpos);
+            data.push_back(std::move(val));
+        });
+        filter.build();
+        setRangeDels(s->getRangeDels());
+        if (!rangeDels.empty()) { // 表的 key 范围也要盖住删除区间，compaction 才会把它和更旧的表放在一起合并
+            minV = std::min(minV, rangeDels.getMin());
+            maxV = std::max(maxV, rangeDels.getMax());
         }
     }
 
-    bool checkSize(std::string val, int curLevel,
-                   int flag);        // 检查大小，如果不够加val, 创新sstable
-    void putFile(const char *path);  //  将sstable输出到路径
-    void loadFile(const char *path); // 从路径载入一个sstable
+    bool putFile(const char *path);  //  将sstable输出到路径并落盘，写不进去时返回 false
+    bool putBlocks(FILE *file);      // 按块格式写出，同时生成 blocks
 
     void insert(uint64_t key, const std::string &val);
 
@@ -1,11 +1,16 @@
 #include "sstablehead.h"
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 
-void sstablehead::loadFileHead(const char *path) { // 只读取文件头
-    FILE *file = fopen(path, "rb+");               // 注意格式为二进制
+bool sstablehead::loadFileHead(const char *path, bool lazy) { // 只读取文件头
+    FILE *file = fopen(path, "rb");                            // 注意格式为二进制
     filename   = path;
+    if (file == NULL) {
+        std::perror(path);
+        return false;
+    }
     int len = std::strlen(path), c = 0;
     std::string suf;
     for (int i = 0; i < len; ++i) {
@@ -21,39 +26,119 @@ void sstablehead::loadFileHead(const char *path) { // 只读取文件头
         nameSuffix = std::stoi(suf);
     else
         nameSuffix = 0;
-    fseek(file, 0, SEEK_SET);
     reset();
-
-    fread(&time, 8, 1, file);
-    fread(&cnt, 8, 1, file);
-    fread(&minV, 8, 1, file);
-    fread(&maxV, 8, 1, file);
-    for (int i = 0; i < M * 8; i += 8) { // bloom
-        unsigned char cur = 0x0;
-        fread(&cur, 1, 1, file);
-        for (int j = 0; j < 8; ++j) {
-            if ((cur >> j) & 1)
-                filter.setBit(i + j);
+    bool ok = true;
+    if (!loadBlockHead(file, lazy)) {
+        fseek(file, 0, SEEK_END);
+        bytes = ftell(file); // 旧格式的文件大小就是 header + bloom + index + data，不用等 index 读入
+        fseek(file, 0, SEEK_SET);
+        ok = fread(&time, 8, 1, file) == 1 && fread(&cnt, 8, 1, file) == 1 && fread(&minV, 8, 1, file) == 1 &&
+             fread(&maxV, 8, 1, file) == 1;
+        metaOffset = 32;
+        metaSize   = M + 12 * cnt;
+        if (ok && !lazy) { // bloom 和 index 一次读入，读不满时退回懒加载，第一次查找时报错
+            std::vector<unsigned char> meta(metaSize);
+            if (fread(meta.data(), 1, metaSize, file) == metaSize)
+                decodeMeta(meta.data());
+            else
+                this->lazy = std::make_shared<lazyMeta>();
         }
     }
-    Index temp;
-    bytes = 10240 + 32 + 12 * cnt;
-    for (int i = 0; i < cnt; ++i) { // index
-        fread(&temp.key, 8, 1, file);
-        fread(&temp.offset, 4, 1, file);
-        index.push_back(temp);
+    fclose(file);
+    if (!ok) {
+        std::cerr << "Truncated sstable: " << path << std::endl;
+        return false;
+    }
+    if (lazy)
+        this->lazy = std::make_shared<lazyMeta>();
+    return true;
+}
+
+bool sstablehead::loadBlockHead(FILE *file, bool lazy) {
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    if (size < (long)FOOTER_SIZE)
+        return false;
+    char tail[FOOTER_SIZE];
+    Footer footer;
+    fseek(file, size - FOOTER_SIZE, SEEK_SET);
+    if (fread(tail, 1, FOOTER_SIZE, file) != FOOTER_SIZE || !footer.decode(tail))
+        return false;
+    format      = footer.version;
+    time        = footer.time;
+    cnt         = footer.cnt;
+    minV        = footer.minV;
+    maxV        = footer.maxV;
+    bytes       = size;
+    metaOffset  = footer.metaOffset;
+    rangeDelCnt = footer.rangeDelCnt;
+    metaSize    = size - FOOTER_SIZE - metaOffset; // bloom 的长度随 key 数变化，由 meta 区总长度减去 index 得到
+    filterSize  = metaSize - 16 * footer.blockCnt - 16 * rangeDelCnt;
+    if (!lazy) { // bloom 和 block index 连续存放，一次读入
+        std::vector<unsigned char> meta(metaSize);
+        fseek(file, metaOffset, SEEK_SET);
+        if (fread(meta.data(), 1, metaSize, file) == metaSize)
+            decodeMeta(meta.data());
+        else
+            this->lazy = std::make_shared<lazyMeta>(); // 同旧格式，退回懒加载
+    }
+    return true;
+}
+
+bool sstablehead::loadMeta() {
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file == NULL) {
+        std::perror(filename.c_str());
+        return false;
     }
-    bytes += temp.offset;
-    fflush(file);
+    std::vector<unsigned char> meta(metaSize);
+    fseek(file, metaOffset, SEEK_SET);
+    bool ok = fread(meta.data(), 1, metaSize, file) == metaSize;
     fclose(file);
+    if (!ok) {
+        std::cerr << "Truncated sstable meta: " << filename << std::endl;
+        return false;
+    }
+    decodeMeta(meta.data());
+    return true;
+}
+
+void sstablehead::decodeMeta(const unsigned char *meta) {
+    filter.loadBytes(meta, filterSize);
+    const unsigned char *p = meta + filterSize;
+    if (format == FORMAT_BLOCK) {
+        blocks.resize((metaSize - filterSize) / 16 - rangeDelCnt);
+        for (auto &it : blocks) {
+            std::memcpy(&it.lastKey, p, 8);
+            std::memcpy(&it.offset, p + 8, 4);
+            std::memcpy(&it.size, p + 12, 4);
+            p += 16;
+        }
+        rangeDels.decode(p, rangeDelCnt); // 范围删除紧跟在 block index 之后
+        return;
+    }
+    index.resize(cnt);
+    for (auto &it : index) {
+        std::memcpy(&it.key, p, 8);
+        std::memcpy(&it.offset, p + 8, 4);
+        p += 12;
+    }
 }
 
 void sstablehead::reset() {
+    lazy.reset();
     filter.reset();
+    filterSize = M;
     index.clear();
+    blocks.clear();
+    rangeDels.clear();
+    rangeDelCnt = 0;
+    format      = FORMAT_LEGACY;
 }
 
 int sstablehead::search(uint64_t key) {
+    if (!ensureLoaded())
+        return META_ERROR;
     int res = filter.search(key);
     if (!res)
         return -1; // bloom 说没有 确实没有
@@ -66,7 +151,15 @@ int sstablehead::search(uint64_t key) {
 }
 
 int sstablehead::searchOffset(uint64_t key, uint32_t &len) {
-    int res = filter.search(key);
+    uint64_t hash[2];
+    bloom::hash(key, hash);
+    return searchOffset(key, hash, len);
+}
+
+int sstablehead::searchOffset(uint64_t key, const uint64_t *hash, uint32_t &len) {
+    if (!ensureLoaded())
+        return META_ERROR;
+    int res = filter.search(hash);
     if (!res)
         return -1; // bloom 说没有 确实没有
     auto it = std::lower_bound(index.begin(), index.end(), Index(key, 0));
@@ -84,12 +177,37 @@ int sstablehead::searchOffset(uint64_t key, uint32_t &len) {
     return -1;
 }
 
+int sstablehead::searchBlock(uint64_t key) {
+    uint64_t hash[2];
+    bloom::hash(key, hash);
+    return searchBlock(key, hash);
+}
+
+int sstablehead::searchBlock(uint64_t key, const uint64_t *hash) {
+    if (!ensureLoaded())
+        return META_ERROR;
+    if (!filter.search(hash))
+        return -1;
+    auto it = std::lower_bound(blocks.begin(), blocks.end(), BlockHandle(key, 0, 0));
+    if (it == blocks.end())
+        return -1;
+    return it - blocks.begin();
+}
+
+int sstablehead::lowerBoundBlock(uint64_t key) {
+    ensureLoaded();
+    auto it = std::lower_bound(blocks.begin(), blocks.end(), BlockHandle(key, 0, 0));
+    return it - blocks.begin();
+}
+
 int sstablehead::lowerBound(uint64_t key) {
+    ensureLoaded();
     auto it = std::lower_bound(index.begin(), index.end(), Index(key, 0));
     return it - index.begin(); // found
 }
 
 void sstablehead::showIndexs() {
+    ensureLoaded();
     // 打印基本信息
     std::cout << "SSTable Info:" << std::endl;
     std::cout << "Filename: " << filename << std::endl;
@@ -104,4 +222,4 @@ void sstablehead::showIndexs() {
         std::cout << "Index[" << i << "]: key=" << index[i].key 
                  << ", offset=" << index[i].offset << std::endl;
     }
-}
\ No newline at end of file
+}
\ No newline at end of file
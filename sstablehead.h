@@ -2,11 +2,19 @@
 
 #ifndef LSM_KV_SSTABLEHEAD_H
 #define LSM_KV_SSTABLEHEAD_H
+#include "block.h"
 #include "bloom.h"
+#include "rangedel.h"
 
+#include <atomic>
 #include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <limits>
+const int META_ERROR = -2; // 懒加载的 bloom / index 读不出来，查找结果未知
+
 struct Index {
     uint64_t key;
     uint32_t offset;
@@ -33,6 +41,20 @@ protected:
     uint32_t nameSuffix = 0; // 区分同一时间戳，不同文件的姓名后缀
     bloom filter;
     std::vector<Index> index; // index区的每一个元素都是index 包含key和offset
+    uint32_t format = FORMAT_LEGACY; // 文件格式，见 block.h
+    std::vector<BlockHandle> blocks; // 块格式下的稀疏索引，每个 data block 一项
+    rangedel rangeDels;              // 本表的范围删除，只作用于更旧的表
+    uint32_t rangeDelCnt = 0;
+    uint32_t metaOffset = 0, metaSize = 0; // bloom + index 区在文件中的位置和长度
+    uint32_t filterSize = M;               // meta 区开头的 bloom 的长度
+    struct lazyMeta {
+        std::mutex lock;
+        std::atomic<bool> loaded{false};
+    };
+    std::shared_ptr<lazyMeta> lazy; // 懒加载的表头第一次被用到时才读 bloom + index，读失败时下次再试
+
+    void decodeMeta(const unsigned char *meta); // 从 bloom + index 区的原始字节恢复 filter 和 index / blocks
+    bool loadMeta();                            // 打不开或读不满文件时返回 false
 
 public:
     bool operator<(const sstablehead &other) const {
@@ -52,10 +74,24 @@ public:
 
     int getIndexSize()
     {
+        ensureLoaded();
         return index.size();
     }
-    void loadFileHead(const char *path);
+    // lazy 为 true 时只读 header / footer，bloom 和 index 推迟到第一次查找时再读。
+    // 懒加载的表头只通过 shared_ptr 共享，不要在加载前复制。打不开或读不满文件时返回 false
+    bool loadFileHead(const char *path, bool lazy = false);
+
+    // 懒加载的 bloom 和 index 是否可用，没有加载过时先加载；返回 false 时 filter 和 index 为空，不能据此判断 key 不存在
+    bool ensureLoaded() {
+        if (!lazy || lazy->loaded.load(std::memory_order_acquire))
+            return true;
+        std::lock_guard<std::mutex> guard(lazy->lock);
+        if (!lazy->loaded.load(std::memory_order_relaxed) && loadMeta())
+            lazy->loaded.store(true, std::memory_order_release);
+        return lazy->loaded.load(std::memory_order_relaxed);
+    }
     void reset();
+    bool loadBlockHead(FILE *file, bool lazy = false); // 读取块格式的 footer + bloom + block index，旧格式返回 false
 
     void setFilename(std::string filename) {
         this->filename = filename;
@@ -86,13 +122,27 @@ public:
     }
 
     void setFilter(bloom filter) {
-        this->filter.setBitset(filter.getBitset());
+        this->filter     = filter;
+        this->filterSize = filter.size();
     }
 
     void setIndex(std::vector<Index> index) {
         this->index = index;
     } // 使用深复制
 
+    void setFormat(uint32_t format) {
+        this->format = format;
+    }
+
+    void setBlocks(std::vector<BlockHandle> blocks) {
+        this->blocks = blocks;
+    }
+
+    void setRangeDels(const rangedel &rangeDels) {
+        this->rangeDels   = rangeDels;
+        this->rangeDelCnt = rangeDels.size();
+    }
+
     std::string getFilename() {
         return filename;
     }
@@ -113,8 +163,9 @@ public:
         return maxV;
     }
 
+    // 以下按下标取 index / block index，读不出来或下标越界时返回空值
     uint64_t getKey(int p) {
-        return index[p].key;
+        return ensureLoaded() && p >= 0 && p < (int)index.size() ? index[p].key : 0;
     }
 
     uint32_t getBytes() const {
@@ -125,18 +176,52 @@ public:
         return nameSuffix;
     }
 
+    uint32_t getFormat() const {
+        return format;
+    }
+
+    int getBlockCnt() {
+        return ensureLoaded() ? blocks.size() : 0;
+    }
+
+    BlockHandle getBlock(int p) {
+        return ensureLoaded() && p >= 0 && p < (int)blocks.size() ? blocks[p] : BlockHandle(0, 0, 0);
+    }
+
     uint32_t getOffset(int p) {
-        return (p < 0) ? 0 : index[p].offset;
+        return ensureLoaded() && p >= 0 && p < (int)index.size() ? index[p].offset : 0;
+    }
+
+    const rangedel &getRangeDels() {
+        ensureLoaded();
+        return rangeDels;
+    }
+
+    bool hasRangeDels() const { // 只看 footer，不触发懒加载
+        return rangeDelCnt != 0;
+    }
+
+    bool rangeDeleted(uint64_t key) {
+        return rangeDelCnt && getRangeDels().covers(key);
+    }
+
+    bool mayContain(const uint64_t *hash) { // 只查 bloom，hash 为 bloom::hash 预先算好的值；bloom 读不出来时保守地返回 true
+        return !ensureLoaded() || filter.search(hash);
     }
 
     Index getIndexById(int p) {
-        return index[p];
+        return ensureLoaded() && p >= 0 && p < (int)index.size() ? index[p] : Index(0, 0);
     }
 
+    // 以下查找在 bloom / index 读不出来时返回 META_ERROR
     int searchOffset(uint64_t key, uint32_t &len);
+    int searchOffset(uint64_t key, const uint64_t *hash, uint32_t &len); // hash 为 bloom::hash 预先算好的值
 
     int search(uint64_t key);
     int lowerBound(uint64_t key); /*返回大于等于的第一个的下标 没有返回len + 1*/
+    int searchBlock(uint64_t key);     // 块格式：bloom 通过后返回可能包含 key 的块号，否则 -1
+    int searchBlock(uint64_t key, const uint64_t *hash);
+    int lowerBoundBlock(uint64_t key); // 块格式：第一个 lastKey >= key 的块号
     void showIndexs();
 };
 
@@ -0,0 +1,112 @@
+#include "tablebuilder.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+tablebuilder::~tablebuilder() {
+    if (file != nullptr)
+        fclose(file);
+}
+
+bool tablebuilder::open(const std::string &path, uint64_t time, filterPolicy policy) {
+    file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        std::cerr << "Failed to open file: " << path << std::endl;
+        std::cerr << "Error: " << strerror(errno) << std::endl;
+        return false;
+    }
+    filename   = path;
+    failed     = false;
+    this->time = time;
+    cnt        = 0;
+    minV       = UINT64_MAX;
+    maxV       = 0;
+    offset     = 0;
+    bytes      = 10240 + 32;
+    filter.reset(policy);
+    blocks.clear();
+    rangeDels.clear();
+    cur.clear();
+    return true;
+}
+
+void tablebuilder::flushBlock() {
+    blocks.emplace_back(lastKey, offset, cur.size());
+    uint32_t padded = (cur.size() + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE; // 下一个块按 BLOCK_SIZE 对齐
+    cur.resize(padded, '\0');
+    failed |= fwrite(cur.data(), 1, cur.size(), file) != cur.size();
+    offset += padded;
+    cur.clear();
+}
+
+void tablebuilder::add(uint64_t key, const std::string &val) {
+    if (cur.size() && cur.size() + 12 + val.length() > BLOCK_SIZE) // 放不下，先结束当前块
+        flushBlock();
+    block::append(cur, key, val);
+    cnt++;
+    lastKey = key;
+    minV    = std::min(minV, key);
+    maxV    = std::max(maxV, key);
+    bytes += 12 + val.length();
+    filter.insert(key);
+}
+
+void tablebuilder::addRangeDel(uint64_t start, uint64_t end) {
+    rangeDels.add(start, end);
+    minV  = std::min(minV, start);
+    maxV  = std::max(maxV, end);
+    bytes += 16;
+}
+
+bool tablebuilder::finish(sstablehead &res) {
+    if (cur.size()) { // 最后一个块不需要 padding
+        blocks.emplace_back(lastKey, offset, cur.size());
+        failed |= fwrite(cur.data(), 1, cur.size(), file) != cur.size();
+        offset += cur.size();
+        cur.clear();
+    }
+    Footer footer;
+    footer.time        = time;
+    footer.cnt         = cnt;
+    footer.minV        = minV;
+    footer.maxV        = maxV;
+    footer.metaOffset  = offset;
+    footer.blockCnt    = blocks.size();
+    footer.version     = FORMAT_BLOCK;
+    footer.rangeDelCnt = rangeDels.size();
+
+    filter.build(); // key 数到这里才确定
+    std::string buf(filter.size(), '\0');
+    filter.dumpBytes(reinterpret_cast<unsigned char *>(&buf[0]));
+    for (auto &it : blocks) {
+        buf.append(reinterpret_cast<const char *>(&it.lastKey), 8);
+        buf.append(reinterpret_cast<const char *>(&it.offset), 4);
+        buf.append(reinterpret_cast<const char *>(&it.size), 4);
+    }
+    rangeDels.encode(buf);
+    footer.encode(buf);
+    failed |= fwrite(buf.data(), 1, buf.size(), file) != buf.size();
+    failed |= utils::syncFile(file) != 0; // 记入 MANIFEST、删除输入之前输出必须已经落盘
+    failed |= fclose(file) != 0;
+    file = nullptr;
+    if (failed) {
+        std::perror(filename.c_str());
+        utils::rmfile(filename.c_str());
+        return false;
+    }
+
+    res.setFilename(filename);
+    res.setTime(time);
+    res.setCnt(cnt);
+    res.setMinV(minV);
+    res.setMaxV(maxV);
+    res.setBytes(bytes);
+    res.setFilter(filter);
+    res.setFormat(FORMAT_BLOCK);
+    res.setBlocks(blocks);
+    res.setRangeDels(rangeDels);
+    return true;
+}
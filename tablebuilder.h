@@ -0,0 +1,59 @@
+#pragma once
+
+#ifndef LSM_KV_TABLEBUILDER_H
+#define LSM_KV_TABLEBUILDER_H
+
+#include "block.h"
+#include "bloom.h"
+#include "rangedel.h"
+#include "sstablehead.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * 按块格式边写边落盘的 sstable：key 必须递增地 add，每攒满一个块就写出，
+ * 内存中只保留当前块、过滤器和 block index。compaction 用它输出新表。
+ */
+class tablebuilder {
+private:
+    FILE *file = nullptr;
+    std::string filename;
+    uint64_t time = 0, cnt = 0;
+    uint64_t minV = 0, maxV = 0; // 包括删除区间
+    uint64_t lastKey = 0;         // 最后加入的 key，即当前块的 lastKey
+    uint32_t offset = 0;         // 已写出的字节数，即下一个块的起始位置
+    uint32_t bytes  = 10240 + 32; // 与 sstable::getBytes 相同的口径，调用者据此切分输出
+    bloom filter;
+    std::vector<BlockHandle> blocks;
+    rangedel rangeDels;
+    std::string cur; // 正在攒的块
+    bool failed = false; // 有一次写入没有写全
+
+    void flushBlock();
+
+public:
+    ~tablebuilder();
+
+    bool open(const std::string &path, uint64_t time, filterPolicy policy = filterPolicy());
+    void add(uint64_t key, const std::string &val);
+    void addRangeDel(uint64_t start, uint64_t end); // 删除区间可以不按顺序加入
+    // 写出最后一个块、bloom、block index 和 footer 并落盘，表头写入 res；写不进去时删掉文件返回 false
+    bool finish(sstablehead &res);
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    uint64_t getCnt() const {
+        return cnt;
+    }
+
+    uint32_t getBytes() const {
+        return bytes;
+    }
+};
+
+#endif // LSM_KV_TABLEBUILDER_H
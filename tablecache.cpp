@@ -0,0 +1,153 @@
+#include "tablecache.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+tablecache::Table::~Table() {
+    if (map != nullptr)
+        munmap(const_cast<char *>(map), size);
+    ::close(fd);
+}
+
+void tablecache::evict(Shard &shard) {
+    while (shard.lru.size() > capacity) { // 只是从缓存中移除，最后一个引用释放时才 close
+        shard.table.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+    }
+}
+
+// 没有缓存时在锁外打开，其他线程同时打开了同一个文件时用先放进缓存的那个，自己的句柄随即关闭
+tablecache::TableRef tablecache::open(const std::string &file) {
+    Shard &shard = shardOf(file);
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto it = shard.table.find(file);
+        if (it != shard.table.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            return it->second->second;
+        }
+    }
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    TableRef ref = std::make_shared<Table>(fd);
+    struct stat st;
+    if (mmapMode && fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) { // 映射失败时退回 pread
+            ref->map  = static_cast<const char *>(addr);
+            ref->size = st.st_size;
+            madvise(addr, st.st_size, MADV_RANDOM); // 以点查为主，顺序读由 advise 提示
+        }
+    }
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.table.find(file);
+    if (it != shard.table.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return it->second->second;
+    }
+    shard.lru.emplace_front(file, ref);
+    shard.table[file] = shard.lru.begin();
+    evict(shard);
+    return ref;
+}
+
+void tablecache::setCapacity(size_t capacity) {
+    this->capacity = std::max<size_t>(1, capacity / TABLE_CACHE_SHARDS);
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        evict(shard);
+    }
+}
+
+void tablecache::setMmap(bool on) {
+    if (mmapMode.exchange(on) == on)
+        return;
+    clear();
+}
+
+long tablecache::read(const std::string &file, uint32_t offset, uint32_t len, std::string &val) {
+    TableRef ref = open(file);
+    if (!ref)
+        return -1;
+    if (ref->map != nullptr) {
+        size_t done = offset < ref->size ? std::min<size_t>(len, ref->size - offset) : 0;
+        val.assign(ref->map + offset, done);
+        return done;
+    }
+    val.resize(len);
+    size_t done = 0;
+    while (done < len) { // pread 可能读不满，循环读到 len 或文件尾
+        ssize_t ret = ::pread(ref->fd, &val[done], len - done, offset + done);
+        if (ret <= 0)
+            break;
+        done += ret;
+    }
+    return done;
+}
+
+bool tablecache::view(const std::string &file, uint32_t offset, uint32_t len, std::string_view &val,
+                      readLease &lease) {
+    TableRef ref = open(file);
+    if (!ref)
+        return false;
+    if (ref->map != nullptr) {
+        if ((size_t)offset + len > ref->size)
+            return false;
+        val   = std::string_view(ref->map + offset, len);
+        lease = ref;
+        return true;
+    }
+    auto buf = std::make_shared<std::string>();
+    if (read(file, offset, len, *buf) != len)
+        return false;
+    val   = *buf;
+    lease = buf;
+    return true;
+}
+
+void tablecache::advise(const std::string &file, uint32_t offset, uint32_t len) {
+    TableRef ref = open(file);
+    if (!ref)
+        return;
+    if (ref->map == nullptr) {
+        posix_fadvise(ref->fd, offset, len, POSIX_FADV_WILLNEED);
+        return;
+    }
+    if (offset >= ref->size)
+        return;
+    size_t page  = sysconf(_SC_PAGESIZE);
+    size_t start = offset / page * page; // madvise 的起点要按页对齐
+    size_t end   = std::min<size_t>((size_t)offset + len, ref->size);
+    madvise(const_cast<char *>(ref->map) + start, end - start, MADV_WILLNEED);
+}
+
+void tablecache::erase(const std::string &file) {
+    Shard &shard = shardOf(file);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.table.find(file);
+    if (it == shard.table.end())
+        return;
+    shard.lru.erase(it->second);
+    shard.table.erase(it);
+}
+
+void tablecache::clear() {
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.lru.clear();
+        shard.table.clear();
+    }
+}
+
+size_t tablecache::getOpenCnt() {
+    size_t cnt = 0;
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        cnt += shard.lru.size();
+    }
+    return cnt;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef LSM_KV_TABLECACHE_H
+#define LSM_KV_TABLECACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/*
+ * 以文件名为 key 缓存已打开的 sstable 文件描述符，读取用 pread，不再每次 fopen/fseek/fclose。
+ * 打开的文件数有上限，超过时按 LRU 关闭；delsstable 删除文件时调用 erase。
+ * 句柄用 shared_ptr 持有，被淘汰时正在读的线程仍然可以读完。
+ * mmap 模式下打开文件时把整个文件映射为只读，read 从映射区复制，view 直接返回映射区中的一段；
+ * 映射随句柄在最后一个引用释放时解除，view 返回的 lease 就是句柄，持有期间数据一直有效。
+ * 文件写完之后才会被读，且不再修改，映射不会读到变化中的内容。
+ * 和 blockcache 一样按文件名分片，每个分片一把锁，容量平均分给各分片；打开文件和 mmap 不持有锁。
+ */
+const size_t DEFAULT_TABLE_CACHE_CAPACITY = 512;
+const size_t TABLE_CACHE_SHARDS           = 16;
+
+using readLease = std::shared_ptr<const void>; // 持有期间 view 返回的数据有效
+
+class tablecache {
+private:
+    struct Table {
+        int fd;
+        const char *map = nullptr; // mmap 模式下整个文件的映射
+        size_t size     = 0;
+
+        Table(int fd) {
+            this->fd = fd;
+        }
+
+        ~Table();
+    };
+
+    using TableRef = std::shared_ptr<Table>;
+
+    struct Shard {
+        std::mutex lock;
+        std::list<std::pair<std::string, TableRef>> lru; // 表头是最近使用的
+        std::unordered_map<std::string, std::list<std::pair<std::string, TableRef>>::iterator> table;
+    };
+
+    Shard shards[TABLE_CACHE_SHARDS];
+    std::atomic<size_t> capacity; // 每个分片的容量，至少为 1
+    std::atomic<bool> mmapMode{false};
+
+    Shard &shardOf(const std::string &file) {
+        return shards[std::hash<std::string>()(file) % TABLE_CACHE_SHARDS];
+    }
+
+    void evict(Shard &shard); // 调用者持有分片锁
+    TableRef open(const std::string &file);
+
+public:
+    tablecache(size_t capacity = DEFAULT_TABLE_CACHE_CAPACITY) {
+        setCapacity(capacity);
+    }
+
+    void setCapacity(size_t capacity);
+    void setMmap(bool on); // 只影响之后打开的文件，已打开的句柄清出缓存
+
+    bool isMmap() const {
+        return mmapMode;
+    }
+
+    // 从 file 的 offset 处读 len 字节到 val，返回实际读到的字节数，打不开文件返回 -1
+    long read(const std::string &file, uint32_t offset, uint32_t len, std::string &val);
+    // 不复制地取 file 中 [offset, offset + len)：mmap 模式下指向映射区，否则读到 lease 持有的缓冲区。读不满返回 false
+    bool view(const std::string &file, uint32_t offset, uint32_t len, std::string_view &val, readLease &lease);
+    void advise(const std::string &file, uint32_t offset, uint32_t len); // 提示内核预读这一段
+    void erase(const std::string &file);
+    void clear();
+
+    size_t getOpenCnt();
+};
+
+#endif // LSM_KV_TABLECACHE_H
@@ -0,0 +1,69 @@
+#include "kvstore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 并发读取性能测试：先写入 KEYS 个 key 并等待落盘，再用 1 到 N 个线程同时随机 get，
+// 另有一个线程持续写入，测量读的总吞吐量和相对单线程的加速比。
+// 读者每次 get 只取一次快照，不与写者、落盘和 compaction 争锁。
+
+const std::string DATA_DIR = "./data";
+const int KEYS             = 200000;
+const int GETS_PER_THREAD  = 200000;
+const int VALUE_SIZE       = 100;
+
+double getsPerSecond(KVStore &store, int threads) {
+    std::atomic<bool> reading{true};
+    std::thread writer([&store, &reading] { // 读的同时不断覆盖写，memtable 会被冻结、落盘
+        std::string value(VALUE_SIZE, 'w');
+        for (uint64_t key = 0; reading; key = (key + 1) % KEYS)
+            store.put(key, value);
+    });
+    std::vector<std::thread> readers;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        readers.emplace_back([&store, t] {
+            uint64_t key = t;
+            for (int i = 0; i < GETS_PER_THREAD; ++i) {
+                key = (key * 2862933555777941757ULL + 3037000493ULL) % KEYS;
+                store.get(key);
+            }
+        });
+    }
+    for (auto &it : readers)
+        it.join();
+    auto end = std::chrono::high_resolution_clock::now();
+    reading = false;
+    writer.join();
+    double s = std::chrono::duration<double>(end - start).count();
+    return (double)threads * GETS_PER_THREAD / s;
+}
+
+int main(int argc, char *argv[]) {
+    int maxThreads = argc > 1 ? std::stoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    KVStore store(DATA_DIR);
+    store.reset();
+    store.setWalSyncMode(WAL_NO_SYNC);
+    std::string value(VALUE_SIZE, 'v');
+    for (uint64_t key = 0; key < KEYS; ++key)
+        store.put(key, value);
+    std::cout << "KVStore Concurrent Get Benchmark (" << KEYS << " keys of " << VALUE_SIZE << " bytes, "
+              << GETS_PER_THREAD << " gets per thread, 1 writer)" << std::endl;
+    std::cout << std::setw(10) << "threads" << std::setw(15) << "gets/s" << std::setw(15) << "speedup" << std::endl;
+    double base = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double rate = getsPerSecond(store, threads);
+        if (threads == 1)
+            base = rate;
+        std::cout << std::setw(10) << threads << std::setw(15) << std::fixed << std::setprecision(0) << rate
+                  << std::setw(15) << std::setprecision(2) << rate / base << std::endl;
+    }
+    store.reset();
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include "kvstore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 并发写入性能测试：1 到 N 个线程同时 put 互不相交的 key，测量总吞吐量和相对单线程的加速比。
+// WAL 不刷盘，测的是 memtable 和 group commit 的扩展性。
+
+const std::string DATA_DIR = "./data";
+const int KEYS_PER_RUN     = 200000;
+const int VALUE_SIZE       = 100;
+
+double putsPerSecond(int threads) {
+    KVStore store(DATA_DIR);
+    store.reset();
+    store.setWalSyncMode(WAL_NO_SYNC);
+    std::string value(VALUE_SIZE, 'v');
+    std::vector<std::thread> writers;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        writers.emplace_back([&store, &value, threads, t] {
+            for (uint64_t key = t; key < KEYS_PER_RUN; key += threads)
+                store.put(key, value);
+        });
+    }
+    for (auto &it : writers)
+        it.join();
+    auto end = std::chrono::high_resolution_clock::now();
+    double s = std::chrono::duration<double>(end - start).count();
+    store.reset();
+    return KEYS_PER_RUN / s;
+}
+
+int main(int argc, char *argv[]) {
+    int maxThreads = argc > 1 ? std::stoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "KVStore Concurrent Put Benchmark (" << KEYS_PER_RUN << " puts of " << VALUE_SIZE << " bytes)"
+              << std::endl;
+    std::cout << std::setw(10) << "threads" << std::setw(15) << "puts/s" << std::setw(15) << "speedup" << std::endl;
+    double base = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double rate = putsPerSecond(threads);
+        if (threads == 1)
+            base = rate;
+        std::cout << std::setw(10) << threads << std::setw(15) << std::fixed << std::setprecision(0) << rate
+                  << std::setw(15) << std::setprecision(2) << rate / base << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "kvstore.h"
+#include "utils.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// 启动性能测试：在 level-1 下生成不同数量的 sstable，测量从构造 KVStore 到第一次 get 返回的时间。
+// 每个数量分别测懒加载和全量加载两种方式。
+
+const std::string DATA_DIR  = "./data";
+const int KEYS_PER_TABLE    = 64;
+const int VALUE_SIZE        = 100;
+std::vector<int> tableCnts  = {100, 500, 1000, 2000, 4000};
+
+void clearDir() {
+    KVStore store(DATA_DIR);
+    store.reset();
+}
+
+// 直接写出 cnt 个互不重叠的 sstable，再打开一次让 KVStore 生成 MANIFEST
+void prepare(int cnt) {
+    clearDir();
+    std::string path = DATA_DIR + "/level-1/";
+    utils::mkdir(path.data());
+    std::string value(VALUE_SIZE, 'v');
+    for (int i = 0; i < cnt; ++i) {
+        sstable ss;
+        for (int j = 0; j < KEYS_PER_TABLE; ++j)
+            ss.insert((uint64_t)i * KEYS_PER_TABLE + j, value);
+        ss.setTime(i + 1);
+        ss.setFilename(path + std::to_string(i + 1) + ".sst");
+        ss.putFile(ss.getFilename().data());
+    }
+    utils::rmfile((DATA_DIR + "/MANIFEST").data());
+    KVStore store(DATA_DIR);
+}
+
+double timeToFirstGet(int cnt, bool lazyLoad) {
+    auto start = std::chrono::high_resolution_clock::now();
+    double ms;
+    {
+        KVStore store(DATA_DIR, DEFAULT_CACHE_CAPACITY, lazyLoad);
+        std::string res = store.get((uint64_t)(cnt / 2) * KEYS_PER_TABLE);
+        auto end        = std::chrono::high_resolution_clock::now();
+        ms              = std::chrono::duration<double, std::milli>(end - start).count();
+        if (res.length() != VALUE_SIZE)
+            std::cerr << "unexpected value for table " << cnt / 2 << std::endl;
+    }
+    return ms;
+}
+
+int main() {
+    std::cout << "KVStore Startup Benchmark (time to first get)" << std::endl;
+    std::cout << std::setw(10) << "tables" << std::setw(15) << "lazy(ms)" << std::setw(15) << "eager(ms)"
+              << std::endl;
+    for (int cnt : tableCnts) {
+        prepare(cnt);
+        double lazy  = timeToFirstGet(cnt, true);
+        double eager = timeToFirstGet(cnt, false);
+        std::cout << std::setw(10) << cnt << std::setw(15) << std::fixed << std::setprecision(2) << lazy
+                  << std::setw(15) << eager << std::endl;
+    }
+    clearDir();
+    return 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#ifndef LSM_KV_THREADPOOL_H
+#define LSM_KV_THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+//-------------------------------------------------------------------------------------------------
+// 线程池 (Thread Pool)
+//-------------------------------------------------------------------------------------------------
+class ThreadPool {
+public:
+  ThreadPool(size_t num_threads) : stop(false) {
+    for (size_t i = 0; i < num_threads; ++i) {
+      workers.emplace_back([this] {
+        while (true) {
+          std::function<void()> task;
+          {
+            std::unique_lock<std::mutex> lock(this->queue_mutex);
+            this->condition.wait(
+                lock, [this] { return this->stop || !this->tasks.empty(); });
+            if (this->stop && this->tasks.empty()) {
+              return;
+            }
+            task = std::move(this->tasks.front());
+            this->tasks.pop();
+          }
+          task();
+        }
+      });
+    }
+  }
+
+  template <class F> void enqueue(F &&f) {
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      if (stop) {
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+      }
+      tasks.emplace(std::forward<F>(f));
+    }
+    condition.notify_one();
+  }
+
+  // 提交任务并返回 future，用于需要等待结果的场景
+  template <class F> auto submit(F &&f) -> std::future<decltype(f())> {
+    auto task = std::make_shared<std::packaged_task<decltype(f())()>>(
+        std::forward<F>(f));
+    std::future<decltype(f())> res = task->get_future();
+    enqueue([task] { (*task)(); });
+    return res;
+  }
+
+  ~ThreadPool() {
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      stop = true;
+    }
+    condition.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+private:
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex queue_mutex;
+  std::condition_variable condition;  //条件变量
+  bool stop;
+};
+
+#endif // LSM_KV_THREADPOOL_H
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstdio>
 #include <sstream>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <cstdint>
 #include <vector>
+#include "MurmurHash3.h"
 #include "embedding.h"
 #ifdef _WIN32
 #include <direct.h>
@@ -14,10 +17,23 @@
 #if defined(__linux__) || defined(__MINGW32__) || defined(__APPLE__)
 #include <cstring>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
 namespace utils {
+/**
+ * Checksum of the records in MANIFEST, WAL and value log
+ * @param buf data to be checked.
+ * @param len byte number of data.
+ * @return low 32 bits of the 128-bit murmur hash.
+ */
+static inline uint32_t checksum(const char *buf, uint32_t len) {
+    uint64_t hash[2];
+    MurmurHash3_x64_128(buf, len, 1, hash);
+    return (uint32_t)hash[0];
+}
+
 /**
  * Check whether directory exists
  * @param path directory to be checked.
@@ -137,4 +153,37 @@ static inline int rmfile(const char *path) {
 #endif
 }
 
+/**
+ * Flush a file opened by fopen to disk
+ * @param file file to be flushed.
+ * @return 0 if the data reaches disk successfully, -1 otherwise.
+ */
+static inline int syncFile(FILE *file) {
+    if (fflush(file) != 0)
+        return -1;
+#ifdef _WIN32
+    return ::_commit(::_fileno(file));
+#else
+    return ::fsync(::fileno(file));
+#endif
+}
+
+/**
+ * Flush a directory, so that files created in it survive a power loss
+ * @param path directory to be flushed.
+ * @return 0 if flush successfully, -1 otherwise.
+ */
+static inline int syncDir(const char *path) {
+#ifdef _WIN32
+    return 0; // 目录项随文件一起落盘
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    int ret = ::fsync(fd);
+    ::close(fd);
+    return ret;
+#endif
+}
+
 } // namespace utils
@@ -0,0 +1,112 @@
+#include "vectormemtable.h"
+
+#include <algorithm>
+
+void vectormemtable::init() {
+    std::vector<entry>().swap(entries);
+    sorted     = true;
+    indexBytes = 0;
+}
+
+// 按 key 稳定排序，同一个 key 只留最后写入的一条
+void vectormemtable::sortLocked() {
+    if (sorted)
+        return;
+    std::stable_sort(entries.begin(), entries.end(), [](const entry &a, const entry &b) { return a.key < b.key; });
+    size_t n = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (n && entries[n - 1].key == entries[i].key) {
+            account(entries[n - 1].val, nullptr); // 被覆盖的旧 value 不再计入 bytes
+            entries[n - 1] = entries[i];
+        } else
+            entries[n++] = entries[i];
+    }
+    entries.resize(n);
+    sorted = true;
+}
+
+std::shared_lock<std::shared_mutex> vectormemtable::readLock() {
+    while (true) {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        if (sorted)
+            return guard;
+        guard.unlock();
+        std::unique_lock<std::shared_mutex> exclusive(lock);
+        sortLocked();
+    }
+}
+
+vectormemtable::entry *vectormemtable::find(uint64_t key) {
+    auto it = std::lower_bound(entries.begin(), entries.end(), key,
+                               [](const entry &a, uint64_t key) { return a.key < key; });
+    return it != entries.end() && it->key == key ? &*it : nullptr;
+}
+
+// 有序时二分找旧记录，找到就原地替换；已经乱序时不知道中间是否有这个 key，按新 key 追加并返回 -1，
+// 重复的 key 留到排序时去掉，这之前 bytes 会偏大
+int64_t vectormemtable::upsert(uint64_t key, std::string_view val) {
+    const char *rec = newValue(val);
+    std::unique_lock<std::shared_mutex> guard(lock);
+    entry *e = nullptr;
+    if (!entries.empty() && entries.back().key == key)
+        e = &entries.back();
+    else if (!entries.empty() && entries.back().key > key) {
+        if (sorted)
+            e = find(key);
+        sorted = sorted && e;
+    }
+    if (e) {
+        const char *old = e->val;
+        e->val          = rec;
+        return account(old, rec);
+    }
+    entries.push_back({key, rec});
+    indexBytes = entries.capacity() * sizeof(entry);
+    return account(nullptr, rec);
+}
+
+std::string vectormemtable::search(uint64_t key) {
+    auto guard = readLock();
+    entry *e   = find(key);
+    return e ? std::string(view(e->val)) : "";
+}
+
+bool vectormemtable::del(uint64_t key) {
+    std::unique_lock<std::shared_mutex> guard(lock);
+    sortLocked();
+    entry *e = find(key);
+    if (!e || !e->val)
+        return false;
+    account(e->val, nullptr);
+    e->val = nullptr;
+    return true;
+}
+
+void vectormemtable::removeRange(uint64_t key1, uint64_t key2) {
+    std::unique_lock<std::shared_mutex> guard(lock);
+    sortLocked();
+    auto it = std::lower_bound(entries.begin(), entries.end(), key1,
+                               [](const entry &a, uint64_t key) { return a.key < key; });
+    for (; it != entries.end() && it->key <= key2; ++it) {
+        account(it->val, nullptr);
+        it->val = nullptr;
+    }
+}
+
+void vectormemtable::scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) {
+    auto guard = readLock();
+    auto it    = std::lower_bound(entries.begin(), entries.end(), key1,
+                                  [](const entry &a, uint64_t key) { return a.key < key; });
+    for (; it != entries.end() && it->key <= key2; ++it) {
+        if (it->val)
+            list.emplace_back(it->key, std::string(view(it->val)));
+    }
+}
+
+void vectormemtable::forEach(const memtableVisitor &visit) {
+    auto guard = readLock();
+    for (auto &it : entries) {
+        if (it.val)
+            visit(it.key, view(it.val));
+    }
+}
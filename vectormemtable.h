@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef LSM_KV_VECTORMEMTABLE_H
+#define LSM_KV_VECTORMEMTABLE_H
+
+#include "memtable.h"
+
+#include <shared_mutex>
+
+/*
+ * 有序数组 memtable，适合批量导入：写入只追加到末尾（key 递增时数组保持有序），
+ * 第一次读或落盘时排序一次并去掉被覆盖的旧记录，之后的读只做二分。
+ * 写者互斥，读者共享一把读写锁；写入与读交替的负载每次读都要重新排序，应该用跳表。
+ */
+class vectormemtable : public memtable {
+private:
+    struct entry {
+        uint64_t key;
+        const char *val; // 为空表示已删除
+    };
+
+    std::vector<entry> entries;
+    bool sorted = true; // entries 按 key 严格递增
+    std::atomic<size_t> indexBytes{0}; // entries 占用的内存
+    mutable std::shared_mutex lock;
+
+    void sortLocked();                          // 持有写锁时调用
+    std::shared_lock<std::shared_mutex> readLock(); // 返回时 entries 已排序
+    entry *find(uint64_t key);                  // entries 已排序，不存在返回 nullptr
+
+protected:
+    void init() override;
+    void removeRange(uint64_t key1, uint64_t key2) override;
+
+public:
+    vectormemtable() {
+        init();
+    }
+
+    int64_t upsert(uint64_t key, std::string_view val) override;
+    std::string search(uint64_t key) override;
+    bool del(uint64_t key) override;
+    void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) override;
+    void forEach(const memtableVisitor &visit) override;
+
+    size_t getMemoryUsage() const override {
+        return mem.getUsage() + indexBytes;
+    }
+};
+
+#endif // LSM_KV_VECTORMEMTABLE_H
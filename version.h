@@ -0,0 +1,89 @@
+#pragma once
+
+#ifndef LSM_KV_VERSION_H
+#define LSM_KV_VERSION_H
+
+#include "sstablehead.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+const int MAX_LEVELS = 15;
+
+using HeadRef = std::shared_ptr<sstablehead>;
+
+// value log 回收的代次：回收一个段之后换新的代次，旧代次的 version 全部释放后才删除这个段。
+// 旧代次经 next 引用之后的代次，更早的 version 的读者同样可能读到之后回收的段
+struct gcEpoch {
+    std::shared_ptr<gcEpoch> next;
+};
+
+/*
+ * 某一时刻每一层 sstable 表头的快照。
+ * 装入 KVStore 之后就不再修改：get/scan 持有一个 VersionRef 即可遍历，不需要复制表头；
+ * 写出或删除 sstable 时基于当前 version 复制出一个新的（只复制 shared_ptr），修改后整体替换。
+ */
+class version {
+public:
+    std::vector<HeadRef> levels[MAX_LEVELS];
+    std::shared_ptr<gcEpoch> epoch = std::make_shared<gcEpoch>();
+
+    version() {}
+
+    // 在当前 version 的基础上加入 adds、去掉 dels 中的文件
+    version(const version &base, const std::vector<std::pair<int, HeadRef>> &adds,
+            const std::vector<std::string> &dels)
+        : epoch(base.epoch) {
+        for (int level = 0; level < MAX_LEVELS; ++level) {
+            for (auto &it : base.levels[level]) {
+                bool removed = false;
+                for (auto &file : dels) {
+                    if (it->getFilename() == file) {
+                        removed = true;
+                        break;
+                    }
+                }
+                if (!removed)
+                    levels[level].push_back(it);
+            }
+        }
+        for (auto &it : adds)
+            levels[it.first].push_back(it.second);
+        sortLevels();
+    }
+
+    // level 0 按时间戳从新到旧，查找时遇到的第一个结果就是最新的；
+    // level >= 1 的表互不重叠，按 key 范围排序后可以二分
+    void sortLevels() {
+        std::sort(levels[0].begin(), levels[0].end(), [](const HeadRef &a, const HeadRef &b) {
+            return a->getTime() > b->getTime();
+        });
+        for (int level = 1; level < MAX_LEVELS; ++level) {
+            std::sort(levels[level].begin(), levels[level].end(), [](const HeadRef &a, const HeadRef &b) {
+                return a->getMinV() < b->getMinV();
+            });
+        }
+    }
+
+    // level >= 1 中第一个 maxV >= key 的表的下标，没有返回 levels[level].size()
+    int lowerBound(int level, uint64_t key) const {
+        auto it = std::lower_bound(levels[level].begin(), levels[level].end(), key,
+                                   [](const HeadRef &a, uint64_t key) { return a->getMaxV() < key; });
+        return it - levels[level].begin();
+    }
+
+    // level >= 1 中唯一可能包含 key 的表，没有返回 -1
+    int find(int level, uint64_t key) const {
+        int p = lowerBound(level, key);
+        if (p == (int)levels[level].size() || levels[level][p]->getMinV() > key)
+            return -1;
+        return p;
+    }
+};
+
+using VersionRef = std::shared_ptr<const version>;
+
+#endif // LSM_KV_VERSION_H
@@ -0,0 +1,153 @@
+#include "vlog.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+std::string vlog::writer::append(uint64_t key, const std::string &val) {
+    uint32_t len = val.length();
+    size_t start = buf.size();
+    valuePointer p;
+    p.segment = no;
+    p.offset  = start + 12;
+    p.len     = len;
+    buf.append(reinterpret_cast<const char *>(&key), 8);
+    buf.append(reinterpret_cast<const char *>(&len), 4);
+    buf.append(val);
+    uint32_t sum = utils::checksum(buf.data() + start, 12 + len);
+    buf.append(reinterpret_cast<const char *>(&sum), 4);
+    return encode(p);
+}
+
+bool vlog::writer::finish() {
+    if (buf.empty())
+        return true;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::perror(path.c_str());
+        return false;
+    }
+    bool ok = ::write(fd, buf.data(), buf.size()) == (ssize_t)buf.size() && fdatasync(fd) == 0;
+    ::close(fd);
+    buf.clear();
+    ok = ok && utils::syncDir(path.substr(0, path.rfind('/')).c_str()) == 0; // 新段的目录项也要落盘
+    if (!ok) {
+        std::perror(path.c_str());
+        ::unlink(path.c_str()); // 不完整的段不留给引用它的表
+    }
+    return ok;
+}
+
+void vlog::open(const std::string &dir) {
+    this->dir = dir;
+    if (!utils::dirExists(dir))
+        utils::mkdir(dir.data());
+    auto all = segments();
+    last     = all.empty() ? 0 : all.back();
+}
+
+vlog::writer vlog::newWriter() {
+    uint64_t no = ++last;
+    return writer(path(no), no);
+}
+
+void vlog::clear() {
+    for (uint64_t no : segments())
+        remove(no);
+    last = 0;
+}
+
+std::string vlog::path(uint64_t segment) const {
+    return dir + "/" + std::to_string(segment) + ".vlog";
+}
+
+std::vector<uint64_t> vlog::segments() const {
+    std::vector<uint64_t> ret;
+    std::vector<std::string> names;
+    if (!utils::dirExists(dir))
+        return ret;
+    utils::scanDir(dir, names);
+    for (auto &name : names) {
+        if (name.size() > 5 && name.find_first_not_of("0123456789") == name.size() - 5 &&
+            name.substr(name.size() - 5) == ".vlog")
+            ret.push_back(std::stoull(name));
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+uint64_t vlog::getBytes() const {
+    uint64_t bytes = 0;
+    for (uint64_t no : segments()) {
+        FILE *fp = fopen(path(no).c_str(), "rb");
+        if (fp == NULL)
+            continue;
+        fseek(fp, 0, SEEK_END);
+        bytes += ftell(fp);
+        fclose(fp);
+    }
+    return bytes;
+}
+
+bool vlog::scan(uint64_t segment,
+                const std::function<void(uint64_t key, const std::string &ptr, const std::string &val)> &visit) const {
+    FILE *fp = fopen(path(segment).c_str(), "rb");
+    if (fp == NULL)
+        return false;
+    std::string rec;
+    uint32_t offset = 0;
+    while (true) {
+        char head[12];
+        uint32_t len, sum;
+        if (fread(head, 1, 12, fp) != 12)
+            break;
+        std::memcpy(&len, head + 8, 4);
+        rec.assign(head, 12);
+        rec.resize(12 + len);
+        if (fread(&rec[12], 1, len, fp) != len || fread(&sum, 4, 1, fp) != 1)
+            break; // 写了一半的记录
+        if (utils::checksum(rec.data(), rec.size()) != sum)
+            break;
+        uint64_t key;
+        std::memcpy(&key, head, 8);
+        valuePointer p;
+        p.segment = segment;
+        p.offset  = offset + 12;
+        p.len     = len;
+        visit(key, encode(p), rec.substr(12));
+        offset += 16 + len;
+    }
+    fclose(fp);
+    return true;
+}
+
+void vlog::remove(uint64_t segment) {
+    std::string file = path(segment);
+    utils::rmfile(file.data());
+}
+
+bool vlog::isPointer(std::string_view val) {
+    return val.length() == VLOG_POINTER_SIZE && val.compare(0, VLOG_POINTER.length(), VLOG_POINTER) == 0;
+}
+
+bool vlog::decode(std::string_view val, valuePointer &ptr) {
+    if (!isPointer(val))
+        return false;
+    const char *p = val.data() + VLOG_POINTER.length();
+    std::memcpy(&ptr.segment, p, 8);
+    std::memcpy(&ptr.offset, p + 8, 4);
+    std::memcpy(&ptr.len, p + 12, 4);
+    return true;
+}
+
+std::string vlog::encode(const valuePointer &ptr) {
+    std::string val = VLOG_POINTER;
+    val.append(reinterpret_cast<const char *>(&ptr.segment), 8);
+    val.append(reinterpret_cast<const char *>(&ptr.offset), 4);
+    val.append(reinterpret_cast<const char *>(&ptr.len), 4);
+    return val;
+}
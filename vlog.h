@@ -0,0 +1,84 @@
+#pragma once
+
+#ifndef LSM_KV_VLOG_H
+#define LSM_KV_VLOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * 键值分离的 value log：memtable 落盘时，长度不小于阈值的 value 写入 value log，sstable 中只存指针，
+ * compaction 只搬运 key 和指针，不再重写 value。
+ * 每次落盘写一个编号递增的段文件 <no>.vlog，写完即不再修改。每条记录为 [key u64][len u32][value][checksum u32]，
+ * checksum 覆盖 key、len 和 value，GC 扫描段时据此跳过损坏的尾部。
+ * 指针是一个 VLOG_POINTER 开头、长度为 VLOG_POINTER_SIZE 的 value：[VLOG_POINTER][segment u64][offset u32][len u32]，
+ * offset 为 value 本身在段中的位置。与指针同形的用户 value 总是写入 value log，不会被误认。
+ */
+const std::string VLOG_POINTER         = "~VLOG~";
+const size_t VLOG_POINTER_SIZE         = 6 + 16;
+const uint32_t DEFAULT_VLOG_THRESHOLD  = 1024; // 开启键值分离时默认的 value 长度阈值
+const double DEFAULT_VLOG_GC_THRESHOLD = 0.5;  // 段中失效数据的比例不低于它时才回收
+
+struct vlogStats {
+    uint64_t segments   = 0;
+    uint64_t totalBytes = 0; // 所有段的大小
+    uint64_t liveBytes  = 0; // 仍被引用的记录的大小
+
+    double spaceAmplification() const {
+        return liveBytes ? (double)totalBytes / liveBytes : 0;
+    }
+};
+
+struct valuePointer {
+    uint64_t segment = 0;
+    uint32_t offset  = 0;
+    uint32_t len     = 0;
+};
+
+class vlog {
+private:
+    std::string dir;
+    std::atomic<uint64_t> last{0}; // 已经分配出去的最大段号
+
+public:
+    // 一次落盘写出的段：先在内存中攒齐，finish 时一次写出并 fdatasync，之后才能写引用它的 sstable
+    class writer {
+    private:
+        std::string path;
+        uint64_t no = 0;
+        std::string buf;
+
+    public:
+        writer(const std::string &path, uint64_t no) : path(path), no(no) {}
+
+        std::string append(uint64_t key, const std::string &val); // 返回编码好的指针
+        bool finish();                                            // 没有追加过记录时不创建文件，写不进去时删掉段返回 false
+
+        uint64_t getSegment() const {
+            return no;
+        }
+    };
+
+    void open(const std::string &dir); // 目录不存在时创建，已有段的编号之后继续分配
+    writer newWriter();
+    void clear(); // 删除所有段
+
+    std::string path(uint64_t segment) const;
+    std::vector<uint64_t> segments() const; // 目录中所有段的编号，旧的在前
+    uint64_t getBytes() const;              // 所有段的总字节数
+
+    // 按顺序遍历段中所有完整的记录，ptr 为指向该记录的指针
+    bool scan(uint64_t segment,
+              const std::function<void(uint64_t key, const std::string &ptr, const std::string &val)> &visit) const;
+    void remove(uint64_t segment);
+
+    static bool isPointer(std::string_view val);
+    static bool decode(std::string_view val, valuePointer &ptr);
+    static std::string encode(const valuePointer &ptr);
+};
+
+#endif // LSM_KV_VLOG_H
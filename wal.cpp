@@ -0,0 +1,171 @@
+#include "wal.h"
+
+#include "utils.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool wal::replay(const std::string &path, const std::function<void(uint64_t, const std::string &)> &apply,
+                 const std::function<void(uint64_t, uint64_t)> &applyRange) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL)
+        return false;
+    std::string payload;
+    while (true) {
+        uint32_t len, sum;
+        if (fread(&len, 4, 1, fp) != 1)
+            break;
+        bool range = len & WAL_RANGE_FLAG;
+        len &= ~WAL_RANGE_FLAG;
+        if (len < 8 || (range && len != 16))
+            break;
+        payload.resize(len);
+        if (fread(&payload[0], 1, len, fp) != len || fread(&sum, 4, 1, fp) != 1)
+            break; // 写了一半的记录
+        if (utils::checksum(payload.data(), len) != sum)
+            break;
+        uint64_t key;
+        std::memcpy(&key, payload.data(), 8);
+        if (!range) {
+            apply(key, payload.substr(8));
+            continue;
+        }
+        uint64_t end;
+        std::memcpy(&end, payload.data() + 8, 8);
+        if (applyRange)
+            applyRange(key, end);
+    }
+    fclose(fp);
+    return true;
+}
+
+void wal::open(const std::string &path) {
+    close();
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        std::perror(path.c_str());
+        return;
+    }
+    dirty    = false;
+    stopping = false;
+    syncer     = std::thread(&wal::syncLoop, this);
+}
+
+void wal::close() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    syncCv.notify_all();
+    if (syncer.joinable())
+        syncer.join();
+    if (fd < 0)
+        return;
+    if (dirty)
+        fdatasync(fd);
+    ::close(fd);
+    fd = -1;
+}
+
+void wal::syncLoop() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        syncCv.wait_for(guard, std::chrono::milliseconds(WAL_SYNC_INTERVAL));
+        if (stopping || mode != WAL_PERIODIC_SYNC || !dirty)
+            continue;
+        dirty = false;
+        guard.unlock();
+        fdatasync(fd); // fsync 期间其他线程可以继续追加
+        guard.lock();
+    }
+}
+
+void wal::encode(std::string &buf, uint64_t key, std::string_view val) {
+    uint32_t len = 8 + val.length();
+    size_t start = buf.size();
+    buf.append(reinterpret_cast<const char *>(&len), 4);
+    buf.append(reinterpret_cast<const char *>(&key), 8);
+    buf.append(val);
+    uint32_t sum = utils::checksum(buf.data() + start + 4, len);
+    buf.append(reinterpret_cast<const char *>(&sum), 4);
+}
+
+void wal::encodeRange(std::string &buf, uint64_t start, uint64_t end) {
+    uint32_t len = 16 | WAL_RANGE_FLAG;
+    size_t begin = buf.size();
+    buf.append(reinterpret_cast<const char *>(&len), 4);
+    buf.append(reinterpret_cast<const char *>(&start), 8);
+    buf.append(reinterpret_cast<const char *>(&end), 8);
+    uint32_t sum = utils::checksum(buf.data() + begin + 4, 16);
+    buf.append(reinterpret_cast<const char *>(&sum), 4);
+}
+
+void wal::append(uint64_t key, std::string_view val) {
+    std::string rec;
+    rec.reserve(val.length() + 16);
+    encode(rec, key, val);
+    write(rec);
+}
+
+void wal::appendBatch(const std::string &recs) {
+    if (!recs.empty())
+        write(recs);
+}
+
+void wal::write(const std::string &recs) {
+    bool syncNow = getSyncMode() == WAL_SYNC_BATCH;
+    {
+        std::lock_guard<std::mutex> file(fileLock);
+        if (fd < 0)
+            return;
+        size_t done = 0;
+        while (done < recs.size()) {
+            ssize_t ret = ::write(fd, recs.data() + done, recs.size() - done);
+            if (ret < 0) {
+                std::perror("wal write");
+                break;
+            }
+            done += ret;
+        }
+        if (syncNow)
+            fdatasync(fd);
+    }
+    if (!syncNow) {
+        std::lock_guard<std::mutex> guard(lock);
+        dirty = true;
+    }
+}
+
+void wal::sync() {
+    std::lock_guard<std::mutex> file(fileLock);
+    if (fd < 0)
+        return;
+    fdatasync(fd);
+    std::lock_guard<std::mutex> guard(lock);
+    dirty = false;
+}
+
+void wal::clear() {
+    std::lock_guard<std::mutex> file(fileLock);
+    if (fd < 0)
+        return;
+    // 截断也要落盘，否则崩溃后会把已经写进 sstable 的旧值重放到 memtable，盖住更新的值
+    if (ftruncate(fd, 0) != 0)
+        std::perror("wal truncate");
+    fsync(fd);
+    std::lock_guard<std::mutex> guard(lock);
+    dirty = false;
+}
+
+void wal::setSyncMode(walSync mode) {
+    std::lock_guard<std::mutex> guard(lock);
+    this->mode = mode;
+}
+
+walSync wal::getSyncMode() {
+    std::lock_guard<std::mutex> guard(lock);
+    return mode;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#ifndef LSM_KV_WAL_H
+#define LSM_KV_WAL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/*
+ * 预写日志：put / del 先追加到日志，再写 memtable；memtable 落盘并记入 MANIFEST 之后清空日志。
+ * 每条记录为 [len u32][key u64][value][checksum u32]，len 为 key + value 的长度，del 记录的 value 是删除标记。
+ * deleteRange 的记录为 [len u32][start u64][end u64][checksum u32]，len 的最高位 WAL_RANGE_FLAG 置 1。
+ * 由 KVStore::write 的 leader 在 writeLock 下把一批记录拼好后写入，日志自身不再排队合并：一批记录一次 write（和一次 fsync）。
+ */
+enum walSync {
+    WAL_NO_SYNC,       // 只 write，交给操作系统刷盘
+    WAL_PERIODIC_SYNC, // 后台线程每 WAL_SYNC_INTERVAL 毫秒 fsync 一次
+    WAL_SYNC_BATCH,    // 每一批记录写完都 fsync
+};
+
+const uint32_t WAL_SYNC_INTERVAL = 100;     // ms
+const size_t WAL_MAX_BATCH       = 1 << 20; // KVStore::write 一批最多合并的字节数
+const uint32_t WAL_RANGE_FLAG    = 0x80000000;
+
+class wal {
+private:
+    int fd        = -1;
+    walSync mode  = WAL_PERIODIC_SYNC;
+    bool dirty    = false; // 上次 fsync 之后是否有新写入
+    bool stopping = false;
+    std::mutex lock;
+    std::mutex fileLock; // 写文件、clear 截断文件时持有
+    std::condition_variable syncCv;
+    std::thread syncer;
+
+    void syncLoop();
+    void write(const std::string &recs); // 写出若干条完整的记录
+
+public:
+    ~wal() {
+        close();
+    }
+
+    // 重放 path 处的日志，对每条完整的记录调用 apply（范围删除调用 applyRange）；末尾写了一半的记录直接丢弃。没有日志返回 false
+    static bool replay(const std::string &path, const std::function<void(uint64_t, const std::string &)> &apply,
+                       const std::function<void(uint64_t, uint64_t)> &applyRange = nullptr);
+
+    static void encode(std::string &buf, uint64_t key, std::string_view val); // 追加一条记录到 buf
+    static void encodeRange(std::string &buf, uint64_t start, uint64_t end);
+
+    void open(const std::string &path); // 换日志文件时沿用当前的刷盘方式
+    void close();
+
+    void append(uint64_t key, std::string_view val);
+    void appendBatch(const std::string &recs); // 用 encode / encodeRange 拼好的多条记录，一次写出
+    void sync();  // 立即 fsync
+    void clear(); // memtable 已经持久化，截断日志
+
+    void setSyncMode(walSync mode);
+    walSync getSyncMode();
+};
+
+#endif // LSM_KV_WAL_H